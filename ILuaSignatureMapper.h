@@ -29,6 +29,14 @@
 struct ILuaSignatureMapper {
     /// Map method signature to Lua function name
     virtual QString map( const QString& ) const = 0;
+    /// @brief Return key identifying the mapping.
+    ///
+    /// Class information is shared among the QObjects added with mappers
+    /// returning the same non-empty key, which must therefore map signatures
+    /// in the same way. With an empty key (default) class information is
+    /// shared among the QObjects whose methods are mapped to the same names,
+    /// which requires mapping all the signatures each time a QObject is added.
+    virtual QString cacheKey() const { return QString(); }
     /// Required virtual destructor to allow derived classes to
     /// invoke proper finalization code
     virtual ~ILuaSignatureMapper() {}
@@ -42,8 +42,12 @@ extern "C" {
 #include <QGenericArgument>
 #include <QGenericReturnArgument>
 #include <QVector>
+#include <QHash>
+
+#include <new>
 
 #include "LuaQtTypes.h"
+#include "LuaTableRef.h"
 
 /// QLua namespace
 namespace qlua {
@@ -56,238 +60,323 @@ namespace qlua {
 /// The QLua run-time (indirectly) invokes the QArgConstructor::Create() 
 /// method whenever the invocation of a method of a QObject derived 
 /// class instance is requested from Lua code. 
+/// Constructors do not store any value: values are created in the per-call
+/// memory passed to QArgConstructor::Create, which makes it possible to share
+/// constructors and to re-enter methods from Lua.
 struct QArgConstructor {
-    /// Create a QGenericArgument from Lua values on the Lua stack.
-    virtual QGenericArgument Create( lua_State*, int ) const = 0;
+    /// @brief Raise a Lua error if the Lua value cannot be converted.
+    ///
+    /// Invoked on all the arguments before any value is created: Lua errors
+    /// do not unwind the C++ stack and must therefore be raised before
+    /// creating values which need to be destroyed.
+    virtual void Check( lua_State*, int ) const = 0;
+    /// @brief Return how well a Lua value of the passed type matches the C++
+    /// type: zero if the value cannot be converted, higher values for better
+    /// matches.
+    ///
+    /// Used to select among overloaded methods; the score only depends on the
+    /// Lua type, which makes it possible to cache the selected overload.
+    virtual int Score( int luaType ) const = 0;
+    /// @brief Create a C++ value at the passed memory location from the Lua value
+    /// on the Lua stack and return a QGenericArgument referencing it.
+    ///
+    /// Invoked after Check and possibly after other values were created: no
+    /// Lua error must be raised. If the content of the Lua value cannot be
+    /// converted, e.g. a table element of the wrong type, nothing is left at
+    /// the memory location and a QGenericArgument with null data is returned.
+    virtual QGenericArgument Create( lua_State*, int, void* ) const = 0;
+    /// Destroy value created by Create.
+    virtual void Destroy( void* ) const = 0;
+    /// Size of created value.
+    virtual size_t Size() const = 0;
     /// Virtual destructor.
     virtual ~QArgConstructor() {}
-    /// Create a new instance of the current class.
-    virtual QArgConstructor* Clone() const = 0;
 
 };
 /// QArgConstructor implementation for @c integer type.
 class IntQArgConstructor : public QArgConstructor {
 public:
-    /// @brief Copy @c integer value from Lua stack to data member then create 
-    /// QGenericArgument referencing the data member.
+    /// Check that value is a number.
+    void Check( lua_State* L, int idx ) const {
+        luaL_checkint( L, idx );
+    }
+    /// Numbers match, strings might be convertible.
+    int Score( int luaType ) const {
+        return luaType == LUA_TNUMBER ? 2 : luaType == LUA_TSTRING ? 1 : 0;
+    }
+    /// @brief Copy @c integer value from Lua stack to passed memory location then create
+    /// QGenericArgument referencing the value.
     /// @param L pointer to Lua stack
     /// @param idx position of value on the Lua stack
+    /// @param p memory location where value is created
     /// @return QGenericArgument instance whose @c data field points
-    ///         to a private data member of this class' instance
-    QGenericArgument Create( lua_State* L, int idx ) const {
-        i_ = luaL_checkint( L, idx );
-        return Q_ARG( int, i_ );
-    }
-    /// Make copy through copy constructor.
-    IntQArgConstructor* Clone() const {
-        return new IntQArgConstructor( *this );
+    ///         to the created value
+    QGenericArgument Create( lua_State* L, int idx, void* p ) const {
+        return Q_ARG( int, *new ( p ) int( int( lua_tointeger( L, idx ) ) ) );
     }
-private:
-    /// Storage for value read from Lua stack.
-    mutable int i_;
+    void Destroy( void* ) const {}
+    size_t Size() const { return sizeof( int ); }
 };
 /// QArgConstructor implementation for @c float type.
 class FloatQArgConstructor : public QArgConstructor {
 public:
-    /// @brief Copy @c float value from Lua stack to data member then create 
-    /// QGenericArgument referencing the data member. The value is converted
+    /// Check that value is a number.
+    void Check( lua_State* L, int idx ) const {
+        luaL_checknumber( L, idx );
+    }
+    /// Numbers match, strings might be convertible.
+    int Score( int luaType ) const {
+        return luaType == LUA_TNUMBER ? 2 : luaType == LUA_TSTRING ? 1 : 0;
+    }
+    /// @brief Copy @c float value from Lua stack to passed memory location then create
+    /// QGenericArgument referencing the value. The value is converted
     /// from a Lua double precision number.
     /// @param L pointer to Lua stack
     /// @param idx position of value on the Lua stack
+    /// @param p memory location where value is created
     /// @return QGenericArgument instance whose @c data field points
-    ///         to a private data member of this class' instance
-    QGenericArgument Create( lua_State* L, int idx ) const {
-        f_ = float( luaL_checknumber( L, idx ) );
-        return Q_ARG( double, f_ );
+    ///         to the created value
+    QGenericArgument Create( lua_State* L, int idx, void* p ) const {
+        return Q_ARG( float, *new ( p ) float( float( lua_tonumber( L, idx ) ) ) );
     }
-    /// Make copy through copy constructor.
-    FloatQArgConstructor* Clone() const {
-        return new FloatQArgConstructor( *this );
-    }
-private:
-    /// Storage for value read from Lua stack.
-    mutable float f_;
+    void Destroy( void* ) const {}
+    size_t Size() const { return sizeof( float ); }
 };
 /// QArgConstructor implementation for @c double type.
 class DoubleQArgConstructor : public QArgConstructor {
 public:
-    /// @brief Copy @c double value from Lua stack to data member then create 
-    /// QGenericArgument referencing the data member.
+    /// Check that value is a number.
+    void Check( lua_State* L, int idx ) const {
+        luaL_checknumber( L, idx );
+    }
+    /// Numbers match exactly, strings might be convertible.
+    int Score( int luaType ) const {
+        return luaType == LUA_TNUMBER ? 3 : luaType == LUA_TSTRING ? 1 : 0;
+    }
+    /// @brief Copy @c double value from Lua stack to passed memory location then create
+    /// QGenericArgument referencing the value.
     /// @param L pointer to Lua stack
     /// @param idx position of value on the Lua stack
+    /// @param p memory location where value is created
     /// @return QGenericArgument instance whose @c data field points
-    ///         to a private data member of this class' instance
-    QGenericArgument Create( lua_State* L, int idx ) const {
-        d_ = luaL_checknumber( L, idx );
-        return Q_ARG( double, d_ );
-    }
-    /// Make copy through copy constructor.
-    DoubleQArgConstructor* Clone() const {
-        return new DoubleQArgConstructor( *this );
+    ///         to the created value
+    QGenericArgument Create( lua_State* L, int idx, void* p ) const {
+        return Q_ARG( double, *new ( p ) double( lua_tonumber( L, idx ) ) );
     }
-private:
-    /// Storage for value read from Lua stack.
-    mutable double d_;
+    void Destroy( void* ) const {}
+    size_t Size() const { return sizeof( double ); }
 };
 /// QArgConstructor implementation for @c QString type.
 class StringQArgConstructor : public QArgConstructor {
 public:
-    /// @brief Copy @c string value from Lua stack to data member then create 
-    /// QGenericArgument referencing the data member.
-    /// The value is converted from a Lua string type in plain ASCII format.
+    /// Check that value is a string or a number.
+    void Check( lua_State* L, int idx ) const {
+        luaL_checkstring( L, idx );
+    }
+    /// Strings match exactly, numbers are converted.
+    int Score( int luaType ) const {
+        return luaType == LUA_TSTRING ? 3 : luaType == LUA_TNUMBER ? 1 : 0;
+    }
+    /// @brief Copy @c string value from Lua stack to passed memory location then create
+    /// QGenericArgument referencing the value.
+    /// The value is converted from a UTF-8 encoded Lua string.
     /// @param L pointer to Lua stack
     /// @param idx position of value on the Lua stack
+    /// @param p memory location where value is created
     /// @return QGenericArgument instance whose @c data field points
-    ///         to a private data member of this class' instance
-    QGenericArgument Create( lua_State* L, int idx ) const {
-        s_ = luaL_checkstring( L, idx ); 
-        return Q_ARG( QString, s_ );
-    }
-    /// Make copy through copy constructor.
-    StringQArgConstructor* Clone() const {
-        return new StringQArgConstructor( *this );
+    ///         to the created value
+    QGenericArgument Create( lua_State* L, int idx, void* p ) const {
+        return Q_ARG( QString, *new ( p ) QString( LuaToQString( L, idx ) ) );
     }
-private:
-    /// Storage for value read from Lua stack.
-    mutable QString s_;
+    void Destroy( void* p ) const { reinterpret_cast< QString* >( p )->~QString(); }
+    size_t Size() const { return sizeof( QString ); }
 };
 /// QArgConstructor implementation for @c QVariantMap type.
 class VariantMapQArgConstructor : public QArgConstructor {
 public:
+    /// Check that value is a table.
+    void Check( lua_State* L, int idx ) const {
+        luaL_checktype( L, idx, LUA_TTABLE );
+    }
+    /// Tables match.
+    int Score( int luaType ) const { return luaType == LUA_TTABLE ? 2 : 0; }
     /// @brief Copy @c Lua value in table format from Lua stack to QVariantMap
-    /// data member then create QGenericArgument referencing the data member.
+    /// created at the passed memory location then create QGenericArgument
+    /// referencing the value.
     ///
     /// The value is converted by (possibly) recursively calling the 
     /// @c ParseLuaTable function.
     /// @param L pointer to Lua stack
     /// @param idx position of value on the Lua stack
+    /// @param p memory location where value is created
     /// @return QGenericArgument instance whose @c data field points
-    ///         to a private data member of this class' instance
-    QGenericArgument Create( lua_State* L, int idx ) const {
-        vm_ = ParseLuaTable( L, idx );
-        return Q_ARG( QVariantMap, vm_ );
-    }
-    /// Make copy through copy constructor.
-    VariantMapQArgConstructor* Clone() const {
-        return new VariantMapQArgConstructor( *this );
+    ///         to the created value
+    QGenericArgument Create( lua_State* L, int idx, void* p ) const {
+        return Q_ARG( QVariantMap, *new ( p ) QVariantMap( ParseLuaTable( L, idx, false ) ) );
     }
-private:
-    /// Storage for value read from Lua stack.
-    mutable QVariantMap vm_;
+    void Destroy( void* p ) const { reinterpret_cast< QVariantMap* >( p )->~QVariantMap(); }
+    size_t Size() const { return sizeof( QVariantMap ); }
 };
 /// QArgConstructor implementation for @c QVariantList type.
 class VariantListQArgConstructor : public QArgConstructor {
 public:
+    /// Check that value is a table.
+    void Check( lua_State* L, int idx ) const {
+        luaL_checktype( L, idx, LUA_TTABLE );
+    }
+    /// Tables match.
+    int Score( int luaType ) const { return luaType == LUA_TTABLE ? 2 : 0; }
     /// @brief Copy @c Lua value in table format from Lua stack to QVariantList
-    /// data member then create QGenericArgument referencing the data member.
+    /// created at the passed memory location then create QGenericArgument
+    /// referencing the value.
     ///
     /// The value is converted by recursively calling the 
     /// @c ParseLuaTableAsVariantList function.
     /// @param L pointer to Lua stack
     /// @param idx position of value on the Lua stack
+    /// @param p memory location where value is created
     /// @return QGenericArgument instance whose @c data field points
-    ///         to a private data member of this class' instance
-    QGenericArgument Create( lua_State* L, int idx ) const {
-        vl_ = ParseLuaTableAsVariantList( L, idx );
-        return Q_ARG( QVariantList, vl_ );
+    ///         to the created value
+    QGenericArgument Create( lua_State* L, int idx, void* p ) const {
+        return Q_ARG( QVariantList, *new ( p ) QVariantList( ParseLuaTableAsVariantList( L, idx ) ) );
     }
-    /// Make copy through copy constructor.    
-    VariantListQArgConstructor* Clone() const {
-        return new VariantListQArgConstructor( *this );
+    void Destroy( void* p ) const { reinterpret_cast< QVariantList* >( p )->~QVariantList(); }
+    size_t Size() const { return sizeof( QVariantList ); }
+};
+/// QArgConstructor implementation for @c qlua::LuaTableRef type.
+class TableRefQArgConstructor : public QArgConstructor {
+public:
+    /// Check that value is a table.
+    void Check( lua_State* L, int idx ) const {
+        luaL_checktype( L, idx, LUA_TTABLE );
+    }
+    /// Tables match.
+    int Score( int luaType ) const { return luaType == LUA_TTABLE ? 2 : 0; }
+    /// @brief Create LuaTableRef referencing the table on the Lua stack at
+    /// the passed memory location then create QGenericArgument referencing
+    /// the value.
+    ///
+    /// The table is not converted: values are read when accessed through the
+    /// LuaTableRef methods.
+    /// @param L pointer to Lua stack
+    /// @param idx position of value on the Lua stack
+    /// @param p memory location where value is created
+    /// @return QGenericArgument instance whose @c data field points
+    ///         to the created value
+    QGenericArgument Create( lua_State* L, int idx, void* p ) const {
+        return Q_ARG( qlua::LuaTableRef, *new ( p ) LuaTableRef( L, idx, LuaMainState( L ) ) );
     }
-private:
-    /// Storage for value read from Lua stack.
-    mutable QVariantList vl_;
+    void Destroy( void* p ) const { reinterpret_cast< LuaTableRef* >( p )->~LuaTableRef(); }
+    size_t Size() const { return sizeof( LuaTableRef ); }
 };
 /// QArgConstructor implementation for @c QObject* type.
 class ObjectStarQArgConstructor : public QArgConstructor {
 public:
+    /// Values must be nil or reference a QObject: userdata and tables not
+    /// created by LuaContext are rejected.
+    void Check( lua_State* L, int idx ) const {
+        if( !lua_isnil( L, idx ) && !LuaValueIsQObject( L, idx ) ) {
+            luaL_argerror( L, idx, "QObject expected" );
+        }
+    }
+    /// Proxies and pointers match exactly, tables might wrap a QObject,
+    /// nil is converted to a null pointer; the score only depends on the
+    /// Lua type, values are checked in Check.
+    int Score( int luaType ) const {
+        return luaType == LUA_TUSERDATA || luaType == LUA_TLIGHTUSERDATA ? 3
+               : luaType == LUA_TTABLE || luaType == LUA_TNIL ? 1 : 0;
+    }
     /// @brief Copy @c Lua value in table format from Lua stack to QObject*
-    /// data member then create QGenericArgument referencing the data member.
+    /// created at the passed memory location then create QGenericArgument
+    /// referencing the value.
     ///
-    /// The value is converted from either a Lua table wrapping a QObject* or
-    /// directly from a QObject pointer.
+    /// The value is converted from either a Lua table or proxy wrapping a QObject*
+    /// or directly from a QObject pointer.
     /// @param L pointer to Lua stack
     /// @param idx position of value on the Lua stack
+    /// @param p memory location where value is created
     /// @return QGenericArgument instance whose @c data field points
-    ///         to a private data member of this class' instance
-    QGenericArgument Create( lua_State* L, int idx ) const {
-        if( lua_istable( L, idx ) ) {
-            lua_pushstring( L, "qobject__" );
-            lua_gettable( L, idx );
-            obj_ = *reinterpret_cast< QObject** >( lua_touserdata( L, -1 ) );
-            lua_pop( L, 1 );
-        } else if( lua_islightuserdata( L, idx ) ) {
-            obj_ = reinterpret_cast< QObject* >( lua_touserdata( L, -1 ) );
-        }
-        return Q_ARG( QObject*, obj_ );
-    }
-    /// Make copy through copy constructor.    
-    ObjectStarQArgConstructor* Clone() const {
-        return new ObjectStarQArgConstructor( *this );
+    ///         to the created value
+    QGenericArgument Create( lua_State* L, int idx, void* p ) const {
+        return Q_ARG( QObject*, *new ( p ) QObject*( LuaValueToQObject( L, idx ) ) );
     }
-private:
-    /// Storage for value read from Lua stack.
-    mutable QObject* obj_;
+    void Destroy( void* ) const {}
+    size_t Size() const { return sizeof( QObject* ); }
 };
 /// QArgConstructor implementation for @c QWidget* type.
 class WidgetStarQArgConstructor : public QArgConstructor {
 public:
+    /// Values must be nil or reference a QWidget: userdata and tables not
+    /// created by LuaContext and references to other QObjects are rejected.
+    void Check( lua_State* L, int idx ) const {
+        if( lua_isnil( L, idx ) ) return;
+        if( !LuaValueIsQObject( L, idx ) ) luaL_argerror( L, idx, "QWidget expected" );
+        const QObject* obj = LuaValueToQObject( L, idx );
+        if( obj && !obj->isWidgetType() ) luaL_argerror( L, idx, "QWidget expected" );
+    }
+    /// Proxies and pointers match exactly, tables might wrap a QWidget,
+    /// nil is converted to a null pointer; the score only depends on the
+    /// Lua type, values are checked in Check.
+    int Score( int luaType ) const {
+        return luaType == LUA_TUSERDATA || luaType == LUA_TLIGHTUSERDATA ? 3
+               : luaType == LUA_TTABLE || luaType == LUA_TNIL ? 1 : 0;
+    }
     /// @brief Copy @c Lua value in table format from Lua stack to QWidget*
-    /// data member then create QGenericArgument referencing the data member.
+    /// created at the passed memory location then create QGenericArgument
+    /// referencing the value.
     ///
-    /// The value is converted from either a Lua table wrapping a QWidget* or
-    /// directly from a QWidget pointer.
+    /// The value is converted from either a Lua table or proxy wrapping a QWidget*
+    /// or directly from a QWidget pointer.
     /// @param L pointer to Lua stack
     /// @param idx position of value on the Lua stack
+    /// @param p memory location where value is created
     /// @return QGenericArgument instance whose @c data field points
-    ///         to a private data member of this class' instance
-    QGenericArgument Create( lua_State* L, int idx ) const {
-        if( lua_istable( L, idx ) ) {
-            lua_pushstring( L, "qobject__" );
-            lua_gettable( L, idx );
-            w_ = *reinterpret_cast< QWidget** >( lua_touserdata( L, -1 ) );
-            lua_pop( L, 1 );
-        } else if( lua_islightuserdata( L, idx ) ) {
-            w_ = reinterpret_cast< QWidget* >( lua_touserdata( L, -1 ) );
-        }
-        return Q_ARG( QWidget*, w_ );
-    }
-    /// Make copy through copy constructor.    
-    WidgetStarQArgConstructor* Clone() const {
-        return new WidgetStarQArgConstructor( *this );
+    ///         to the created value
+    QGenericArgument Create( lua_State* L, int idx, void* p ) const {
+        return Q_ARG( QWidget*, *new ( p ) QWidget*(
+                      reinterpret_cast< QWidget* >( LuaValueToQObject( L, idx ) ) ) );
     }
-private:
-    /// Storage for value read from Lua stack.
-    mutable QWidget* w_;
+    void Destroy( void* ) const {}
+    size_t Size() const { return sizeof( QWidget* ); }
 };
 /// QArgConstructor implementation for @c void* type.
 class VoidStarQArgConstructor : public QArgConstructor {
 public:
+    /// No check performed: any value is converted to a pointer.
+    void Check( lua_State*, int ) const {}
+    /// Pointers match exactly, any other value is accepted.
+    int Score( int luaType ) const {
+        return luaType == LUA_TLIGHTUSERDATA ? 3 : luaType == LUA_TUSERDATA ? 2 : 1;
+    }
     /// @brief Copy @c Lua value in table format from Lua stack to void*
-    /// data member then create QGenericArgument referencing the data member.
+    /// created at the passed memory location then create QGenericArgument
+    /// referencing the value.
     /// @param L pointer to Lua stack
     /// @param idx position of value on the Lua stack
+    /// @param p memory location where value is created
     /// @return QGenericArgument instance whose @c data field points
-    ///         to a private data member of this class' instance   
-    QGenericArgument Create( lua_State* L, int idx ) const {
-        v_ = const_cast< void* >( lua_topointer( L, idx ) );
-        return Q_ARG( void*, v_ );
-    }
-    /// Make copy through copy constructor.    
-    VoidStarQArgConstructor* Clone() const {
-        return new VoidStarQArgConstructor( *this );
+    ///         to the created value
+    QGenericArgument Create( lua_State* L, int idx, void* p ) const {
+        return Q_ARG( void*, *new ( p ) void*( const_cast< void* >( lua_topointer( L, idx ) ) ) );
     }
-private:
-    /// Storage for value read from Lua stack.
-    mutable void* v_;
+    void Destroy( void* ) const {}
+    size_t Size() const { return sizeof( void* ); }
 };
 /// QArgConstructor implementation for @c QList<T> type.
 template< typename T >
 class ListQArgConstructor : public QArgConstructor {
 public:
+    /// Check that value is a table or a typed array.
+    void Check( lua_State* L, int idx ) const {
+        if( !IsTypedArray( L, idx ) ) luaL_checktype( L, idx, LUA_TTABLE );
+    }
+    /// Tables and typed arrays match.
+    int Score( int luaType ) const {
+        return luaType == LUA_TTABLE || luaType == LUA_TUSERDATA ? 1 : 0;
+    }
     /// @brief Copy @c Lua value in table format from Lua stack to QList<T>
-    /// data member then create QGenericArgument referencing the data member.
+    /// created at the passed memory location then create QGenericArgument
+    /// referencing the value.
     ///
     /// The element type can be any of:
     ///   - @c int
@@ -295,29 +384,42 @@ public:
     ///   - @c float
     ///   - @c double  
     /// A QList is generated by iterating over the table's values and converting
-    /// each element to the requested numeric type.
+    /// each element to the requested numeric type; typed arrays of any element
+    /// type are copied from the vector data.
     /// @param L pointer to Lua stack
     /// @param idx position of value on the Lua stack
+    /// @param p memory location where value is created
     /// @return QGenericArgument instance whose @c data field points
-    ///         to a private data member of this class' instance
-    QGenericArgument Create( lua_State* L, int idx ) const {
-        l_ = ParseLuaTableAsNumberList< T >( L, idx );
-        return Q_ARG( QList< T >, l_ );
-    }
-    /// Make copy through copy constructor.    
-    ListQArgConstructor* Clone() const {
-        return new ListQArgConstructor< T >( *this );
+    ///         to the created value, null if any element is not a number
+    QGenericArgument Create( lua_State* L, int idx, void* p ) const {
+        QList< T >* l = new ( p ) QList< T >;
+        if( AppendTypedArray< T >( L, idx, *l ) ) return Q_ARG( QList< T >, *l );
+        const int n = LuaArrayLength( L, idx );
+        l->reserve( n );
+        if( !ReadLuaNumberArray< T >( L, idx, n, std::back_inserter( *l ) ) ) {
+            l->~QList< T >();
+            return QGenericArgument();
+        }
+        return Q_ARG( QList< T >, *l );
     }
-private:
-    /// Storage for value read from Lua stack.
-    mutable QList< T > l_;
+    void Destroy( void* p ) const { reinterpret_cast< QList< T >* >( p )->~QList< T >(); }
+    size_t Size() const { return sizeof( QList< T > ); }
 };
 /// QArgConstructor implementation for @c QVector<T> type.
 template< typename T >
 class VectorQArgConstructor : public QArgConstructor {
 public:
+    /// Check that value is a table or a typed array.
+    void Check( lua_State* L, int idx ) const {
+        if( !IsTypedArray( L, idx ) ) luaL_checktype( L, idx, LUA_TTABLE );
+    }
+    /// Tables and typed arrays match.
+    int Score( int luaType ) const {
+        return luaType == LUA_TTABLE || luaType == LUA_TUSERDATA ? 1 : 0;
+    }
     /// @brief Copy @c Lua value in table format from Lua stack to QVector<T>
-    /// data member then create QGenericArgument referencing the data member.
+    /// created at the passed memory location then create QGenericArgument
+    /// referencing the value.
     ///
     /// The element type can be any of:
     ///   - @c int
@@ -325,64 +427,81 @@ public:
     ///   - @c float
     ///   - @c double  
     /// A QVector is generated by iterating over the table's values and converting
-    /// each element to the requested numeric type.
+    /// each element to the requested numeric type; if the value is a typed array
+    /// of the same type the created QVector shares the data with the typed array,
+    /// typed arrays of other types are copied from the vector data.
     /// @param L pointer to Lua stack
     /// @param idx position of value on the Lua stack
+    /// @param p memory location where value is created
     /// @return QGenericArgument instance whose @c data field points
-    ///         to a private data member of this class' instance
-    QGenericArgument Create( lua_State* L, int idx ) const {
-        v_ = ParseLuaTableAsNumberVector< T >( L, idx );
-        return Q_ARG( QVector< T >, v_ );
-    }
-    /// Make copy through copy constructor.    
-    VectorQArgConstructor* Clone() const {
-        return new VectorQArgConstructor< T >( *this );
+    ///         to the created value, null if any element is not a number
+    QGenericArgument Create( lua_State* L, int idx, void* p ) const {
+        const QVector< T >* ta = ToTypedArray< T >( L, idx );
+        if( ta ) return Q_ARG( QVector< T >, *new ( p ) QVector< T >( *ta ) );
+        QVector< T >* v = new ( p ) QVector< T >;
+        if( AppendTypedArray< T >( L, idx, *v ) ) return Q_ARG( QVector< T >, *v );
+        v->resize( LuaArrayLength( L, idx ) );
+        if( !ReadLuaNumberArray< T >( L, idx, v->size(), v->data() ) ) {
+            v->~QVector< T >();
+            return QGenericArgument();
+        }
+        return Q_ARG( QVector< T >, *v );
     }
-private:
-    /// Storage for value read from Lua stack.
-    mutable QVector< T > v_;
+    void Destroy( void* p ) const { reinterpret_cast< QVector< T >* >( p )->~QVector< T >(); }
+    size_t Size() const { return sizeof( QVector< T > ); }
 };
 /// QArgConstructor implementation for @c QStringList type.
 class StringListQArgConstructor : public QArgConstructor {
 public:
+    /// Check that value is a table.
+    void Check( lua_State* L, int idx ) const {
+        luaL_checktype( L, idx, LUA_TTABLE );
+    }
+    /// Tables match.
+    int Score( int luaType ) const { return luaType == LUA_TTABLE ? 1 : 0; }
     /// @brief Copy @c Lua value in table format from Lua stack to QStringList
-    /// data member then create QGenericArgument referencing the data member.
+    /// created at the passed memory location then create QGenericArgument
+    /// referencing the value.
     /// @param L pointer to Lua stack
     /// @param idx position of value on the Lua stack
+    /// @param p memory location where value is created
     /// @return QGenericArgument instance whose @c data field points
-    ///         to a private data member of this class' instance
-    QGenericArgument Create( lua_State* L, int idx ) const {
-        l_ = ParseLuaTableAsStringList( L, idx );
-        return Q_ARG( QStringList, l_ );
-    }
-    /// Make copy through copy constructor.    
-    StringListQArgConstructor* Clone() const {
-        return new StringListQArgConstructor( *this );
+    ///         to the created value, null if any element is neither a string
+    ///         nor a number
+    QGenericArgument Create( lua_State* L, int idx, void* p ) const {
+        QStringList* l = new ( p ) QStringList;
+        if( !ReadLuaStringArray( L, idx, *l ) ) {
+            l->~QStringList();
+            return QGenericArgument();
+        }
+        return Q_ARG( QStringList, *l );
     }
-private:
-    /// Storage for value read from Lua stack.
-    mutable QStringList l_;
+    void Destroy( void* p ) const { reinterpret_cast< QStringList* >( p )->~QStringList(); }
+    size_t Size() const { return sizeof( QStringList ); }
 };
 //------------------------------------------------------------------------------
 /// @brief Abstract base class for return constructors which create Lua values
 /// from C++ values.
+///
+/// As with QArgConstructor, values are not stored inside constructors:
+/// return values are created in the per-call memory passed to
+/// LArgConstructor::Construct.
 class LArgConstructor {
 public:
-    /// @brief Push value on Lua stack, invoked when a value must be returned
-    /// from a method invoked from Lua.
-    virtual void Push( lua_State* ) const = 0;
     /// @brief Push value read from a specific memory location on Lua stack,
-    /// invoked when calling a method as result of signal emission.
+    /// invoked to return values from methods and when calling a Lua function as
+    /// result of signal emission.
     virtual void Push( lua_State* , void* ) const = 0;
+    /// Create default value at memory location; used to store returned values.
+    virtual void Construct( void* ) const = 0;
+    /// Destroy value created by Construct.
+    virtual void Destroy( void* ) const = 0;
+    /// Size of value.
+    virtual size_t Size() const = 0;
     /// Virtual destructor.
     virtual ~LArgConstructor() {}
-    /// Return copy of object.
-    virtual LArgConstructor* Clone() const = 0;
     /// Return type of constructed data.
     virtual QMetaType::Type Type() const = 0;
-    /// @brief Return QGenericReturnArguments holding a reference to the
-    /// memory location where the returned value is stored.
-    QGenericReturnArgument Argument() const { return ga_; }
     /// @brief Return @c true if type is a pointer to a QObject-derived object.
     ///
     /// This is required to have the QLua run-time add the passed QObject into
@@ -390,223 +509,127 @@ public:
     /// receive a reference to a LuaContext which introduces a two-way
     /// dependency between LArgConstructor and LuaContext.
     virtual bool IsQObjectPtr() const { return false; }
-protected:
-    /// Creates return argument of the proper type.
-    template < typename T > void SetArg( T& arg ) {
-        ga_ = QReturnArgument< T >( QMetaType::typeName( Type() ), arg );
-    }
-    /// Placeholder for returned data. 
-    QGenericReturnArgument ga_; // not private, breaks encapsulation
 };
 /// LArgConstructor implementation for @c integer type
 class IntLArgConstructor : public LArgConstructor {
 public:
-    IntLArgConstructor() {
-        SetArg( i_ );
-    }
-    IntLArgConstructor( const IntLArgConstructor& other ) : i_( other.i_ ) {
-        SetArg( i_ );
-    }
-    void Push( lua_State* L ) const {
-        lua_pushinteger( L, i_ );
-    }
     void Push( lua_State* L, void* value ) const {
         lua_pushinteger( L, *reinterpret_cast< int* >( value ) );
     }
-    IntLArgConstructor* Clone() const {
-        return new IntLArgConstructor( *this );
-    }
+    void Construct( void* p ) const { new ( p ) int( 0 ); }
+    void Destroy( void* ) const {}
+    size_t Size() const { return sizeof( int ); }
     QMetaType::Type Type() const { return QMetaType::Int; }
-private:
-    int i_; 
 };
 /// LArgConstructor implementation for @c double type
 class DoubleLArgConstructor : public LArgConstructor {
 public:
-    DoubleLArgConstructor() {
-       SetArg( d_ ); 
-    }
-    DoubleLArgConstructor( const DoubleLArgConstructor& other ) : d_( other.d_ ) {
-       SetArg( d_ );
-    }
-    void Push( lua_State* L ) const {
-        lua_pushnumber( L, d_ );
-    }
     void Push( lua_State* L, void* value ) const {
         lua_pushnumber( L, *reinterpret_cast< double* >( value ) );
     }
-    DoubleLArgConstructor* Clone() const {
-        return new DoubleLArgConstructor( *this );
-    }
+    void Construct( void* p ) const { new ( p ) double( 0 ); }
+    void Destroy( void* ) const {}
+    size_t Size() const { return sizeof( double ); }
     QMetaType::Type Type() const { return QMetaType::Double; }
-private:
-    double d_;
 };
 /// LArgConstructor implementation for @c float type
 class FloatLArgConstructor : public LArgConstructor {
 public:
-    FloatLArgConstructor() {
-       SetArg( f_ ); 
-    }
-    FloatLArgConstructor( const FloatLArgConstructor& other ) : f_( other.f_ ) {
-       SetArg( f_ );
-    }
-    void Push( lua_State* L ) const {
-        lua_pushnumber( L, f_ );
-    }
     void Push( lua_State* L, void* value ) const {
         lua_pushnumber( L, *reinterpret_cast< float* >( value ) );
     }
-    FloatLArgConstructor* Clone() const {
-        return new FloatLArgConstructor( *this );
-    }
+    void Construct( void* p ) const { new ( p ) float( 0 ); }
+    void Destroy( void* ) const {}
+    size_t Size() const { return sizeof( float ); }
     QMetaType::Type Type() const { return QMetaType::Float; }
-private:
-    float f_;
 };
 /// LArgConstructor implementation for @c QString type
 class StringLArgConstructor : public LArgConstructor {
 public:
-    StringLArgConstructor() {
-        SetArg( s_ );
-    }
-    StringLArgConstructor( const StringLArgConstructor& other ) : s_( other.s_ ) {
-        SetArg( s_ );
-    }
-    void Push( lua_State* L ) const {
-        lua_pushstring( L, s_.toAscii().constData() );
-    }
     void Push( lua_State* L, void* value ) const {
-        lua_pushstring( L, reinterpret_cast< QString* >( value )->toAscii().constData() );
-    }
-    StringLArgConstructor* Clone() const {
-        return new StringLArgConstructor( *this );
+        PushQString( L, *reinterpret_cast< QString* >( value ) );
     }
+    void Construct( void* p ) const { new ( p ) QString; }
+    void Destroy( void* p ) const { reinterpret_cast< QString* >( p )->~QString(); }
+    size_t Size() const { return sizeof( QString ); }
     QMetaType::Type Type() const { return QMetaType::QString; }
-private:
-    QString s_;
 };
 /// LArgConstructor implementation for @c void type
 class VoidLArgConstructor : public LArgConstructor {
 public:
-    void Push( lua_State*  ) const {}
     void Push( lua_State*, void* ) const {}
-    VoidLArgConstructor* Clone() const {
-        return new VoidLArgConstructor( *this );
-    }
+    void Construct( void* ) const {}
+    void Destroy( void* ) const {}
+    size_t Size() const { return 0; }
     QMetaType::Type Type() const { return QMetaType::Void; }
 };
 /// LArgConstructor implementation for @c QVariantMap type
 class VariantMapLArgConstructor : public LArgConstructor {
 public:
-    VariantMapLArgConstructor() {
-        SetArg( vm_ );   
-    }
-    VariantMapLArgConstructor( const VariantMapLArgConstructor& other ) : vm_( other.vm_ ) {
-        SetArg( vm_ );
-    }
-    void Push( lua_State* L ) const {
-        VariantMapToLuaTable( vm_, L );
-    }
     void Push( lua_State* L, void* value ) const {
         VariantMapToLuaTable( *reinterpret_cast< QVariantMap* >( value ), L );
     }
-    VariantMapLArgConstructor* Clone() const {
-        return new VariantMapLArgConstructor( *this );
-    }
+    void Construct( void* p ) const { new ( p ) QVariantMap; }
+    void Destroy( void* p ) const { reinterpret_cast< QVariantMap* >( p )->~QVariantMap(); }
+    size_t Size() const { return sizeof( QVariantMap ); }
     QMetaType::Type Type() const { return QMetaType::QVariantMap; }
-private:
-    QVariantMap vm_;
 };
 /// LArgConstructor implementation for @c QVariantList type
 class VariantListLArgConstructor : public LArgConstructor {
 public:
-    VariantListLArgConstructor() {
-        SetArg( vl_ );   
-    }
-    VariantListLArgConstructor( const VariantListLArgConstructor& other ) : vl_( other.vl_ ) {
-        SetArg( vl_ );
-    }
-    void Push( lua_State* L ) const {
-        VariantListToLuaTable( vl_, L );
-    }
     void Push( lua_State* L, void* value ) const {
         VariantListToLuaTable( *reinterpret_cast< QVariantList* >( value ), L );
     }
-    VariantListLArgConstructor* Clone() const {
-        return new VariantListLArgConstructor( *this );
-    }
+    void Construct( void* p ) const { new ( p ) QVariantList; }
+    void Destroy( void* p ) const { reinterpret_cast< QVariantList* >( p )->~QVariantList(); }
+    size_t Size() const { return sizeof( QVariantList ); }
     QMetaType::Type Type() const { return QMetaType::QVariantList; }
-private:
-    QVariantList vl_;
+};
+/// LArgConstructor implementation for @c qlua::LuaTableRef type
+class TableRefLArgConstructor : public LArgConstructor {
+public:
+    void Push( lua_State* L, void* value ) const {
+        reinterpret_cast< LuaTableRef* >( value )->Push( L );
+    }
+    void Construct( void* p ) const { new ( p ) LuaTableRef; }
+    void Destroy( void* p ) const { reinterpret_cast< LuaTableRef* >( p )->~LuaTableRef(); }
+    size_t Size() const { return sizeof( LuaTableRef ); }
+    QMetaType::Type Type() const { return QMetaType::Type( QMetaType::type( QLUA_TABLE_REF ) ); }
 };
 /// LArgConstructor implementation for @c QObject* type
 class ObjectStarLArgConstructor : public LArgConstructor {
 public:
-    ObjectStarLArgConstructor() {
-        SetArg( obj_ );   
-    }
-    ObjectStarLArgConstructor( const ObjectStarLArgConstructor& other ) : obj_( other.obj_ ) {
-        SetArg( obj_ );
-    }
-    void Push( lua_State* L ) const {
-        lua_pushlightuserdata( L, obj_ );
-    }
     void Push( lua_State* L, void* value ) const {
-        lua_pushlightuserdata( L,  value );
-    }
-    ObjectStarLArgConstructor* Clone() const {
-        return new ObjectStarLArgConstructor( *this );
+        lua_pushlightuserdata( L, *reinterpret_cast< QObject** >( value ) );
     }
+    void Construct( void* p ) const { new ( p ) QObject*( 0 ); }
+    void Destroy( void* ) const {}
+    size_t Size() const { return sizeof( QObject* ); }
     bool IsQObjectPtr() const { return true; }
     QMetaType::Type Type() const { return QMetaType::QObjectStar; }
-private:
-    QObject* obj_;
 };
 /// LArgConstructor implementation for @c QWidget* type
 class WidgetStarLArgConstructor : public LArgConstructor {
 public:
-    WidgetStarLArgConstructor() {
-        SetArg( w_ );   
-    }
-    WidgetStarLArgConstructor( const WidgetStarLArgConstructor& other ) : w_( other.w_ ) {
-        SetArg( w_ );
-    }
-    void Push( lua_State* L ) const {
-        lua_pushlightuserdata( L, w_ );
-    }
     void Push( lua_State* L, void* value ) const {
-        lua_pushlightuserdata( L,  value );
-    }
-    WidgetStarLArgConstructor* Clone() const {
-        return new WidgetStarLArgConstructor( *this );
+        lua_pushlightuserdata( L, *reinterpret_cast< QWidget** >( value ) );
     }
+    void Construct( void* p ) const { new ( p ) QWidget*( 0 ); }
+    void Destroy( void* ) const {}
+    size_t Size() const { return sizeof( QWidget* ); }
     bool IsQObjectPtr() const { return true; }
     QMetaType::Type Type() const { return QMetaType::QWidgetStar; }
-private:
-    QWidget* w_;
 };
 /// LArgConstructor implementation for @c void* type
 class VoidStarLArgConstructor : public LArgConstructor {
 public:
-    VoidStarLArgConstructor() {
-        SetArg( v_ );   
-    }
-    VoidStarLArgConstructor( const VoidStarLArgConstructor& other ) : v_( other.v_ ) {
-        SetArg( v_ );
-    }
-    void Push( lua_State* L ) const {
-        lua_pushlightuserdata( L, v_ );
-    }
     void Push( lua_State* L, void* value ) const {
-        lua_pushlightuserdata( L,  value );
-    }
-    VoidStarLArgConstructor* Clone() const {
-        return new VoidStarLArgConstructor( *this );
+        lua_pushlightuserdata( L, *reinterpret_cast< void** >( value ) );
     }
+    void Construct( void* p ) const { new ( p ) void*( 0 ); }
+    void Destroy( void* ) const {}
+    size_t Size() const { return sizeof( void* ); }
     QMetaType::Type Type() const { return QMetaType::VoidStar; }
-private:
-    void* v_;
 };
 /// @brief LArgConstructor implementation for @c QList<T> type.
 ///
@@ -618,24 +641,21 @@ private:
 template < typename T >
 class ListLArgConstructor : public LArgConstructor {
 public:
-    ListLArgConstructor() {
-        SetArg( l_ );   
-    }
-    ListLArgConstructor( const ListLArgConstructor& other ) : l_( other.l_ ) {
-        SetArg( l_ );
-    }
-    void Push( lua_State* L ) const {
-        NumberListToLuaTable< T >( l_, L );
-    }
+    /// Constructor: the type must already be registered, its id is resolved
+    /// once
+    ListLArgConstructor() : type_( QMetaType::Type( QMetaType::type( TypeName< QList< T > >() ) ) ) {}
     void Push( lua_State* L, void* value ) const {
-        NumberListToLuaTable< T >( *reinterpret_cast< QList< T >* >( value ), L );
-    }
-    ListLArgConstructor* Clone() const {
-        return new ListLArgConstructor( *this );
-    }
-    QMetaType::Type Type() const { return QMetaType::Type( QMetaType::type( TypeName< QList< T > >() ) ); }
+        const QList< T >& l = *reinterpret_cast< QList< T >* >( value );
+        if( TypedArraysEnabled( L ) ) PushTypedArray< T >( l.toVector(), L );
+        else NumberListToLuaTable< T >( l, L );
+    }
+    void Construct( void* p ) const { new ( p ) QList< T >; }
+    void Destroy( void* p ) const { reinterpret_cast< QList< T >* >( p )->~QList< T >(); }
+    size_t Size() const { return sizeof( QList< T > ); }
+    QMetaType::Type Type() const { return type_; }
 private:
-    QList< T > l_;
+    /// Meta type id of @c QList<T>
+    QMetaType::Type type_;
 };
 /// @brief LArgConstructor implementation for @c QVector<T> type.
 ///
@@ -647,46 +667,158 @@ private:
 template < typename T >
 class VectorLArgConstructor : public LArgConstructor {
 public:
-    VectorLArgConstructor() {
-        SetArg( v_ );   
-    }
-    VectorLArgConstructor( const VectorLArgConstructor& other ) : v_( other.v_ ) {
-        SetArg( v_ );
-    }
-    void Push( lua_State* L ) const {
-        NumberVectorToLuaTable< T >( v_, L );
-    }
+    /// Constructor: the type must already be registered, its id is resolved
+    /// once
+    VectorLArgConstructor() : type_( QMetaType::Type( QMetaType::type( TypeName< QVector< T > >() ) ) ) {}
     void Push( lua_State* L, void* value ) const {
-        NumberVectorToLuaTable< T >( *reinterpret_cast< QVector< T >* >( value ), L );
-    }
-    VectorLArgConstructor* Clone() const {
-        return new VectorLArgConstructor( *this );
-    }
-    QMetaType::Type Type() const { return QMetaType::Type( QMetaType::type( TypeName< QVector< T > >() ) ); }
+        const QVector< T >& v = *reinterpret_cast< QVector< T >* >( value );
+        if( TypedArraysEnabled( L ) ) PushTypedArray< T >( v, L );
+        else NumberVectorToLuaTable< T >( v, L );
+    }
+    void Construct( void* p ) const { new ( p ) QVector< T >; }
+    void Destroy( void* p ) const { reinterpret_cast< QVector< T >* >( p )->~QVector< T >(); }
+    size_t Size() const { return sizeof( QVector< T > ); }
+    QMetaType::Type Type() const { return type_; }
 private:
-    QVector< T > v_;
+    /// Meta type id of @c QVector<T>
+    QMetaType::Type type_;
 };
 /// LArgConstructor implementation for @c QStringList type
 class StringListLArgConstructor : public LArgConstructor {
 public:
-    StringListLArgConstructor() {
-        SetArg( l_ );   
+    void Push( lua_State* L, void* value ) const {
+        StringListToLuaTable( *reinterpret_cast< QStringList* >( value ), L );
     }
-    StringListLArgConstructor( const StringListLArgConstructor& other ) : l_( other.l_ ) {
-        SetArg( l_ );
+    void Construct( void* p ) const { new ( p ) QStringList; }
+    void Destroy( void* p ) const { reinterpret_cast< QStringList* >( p )->~QStringList(); }
+    size_t Size() const { return sizeof( QStringList ); }
+    QMetaType::Type Type() const { return QMetaType::QStringList; }
+};
+
+//------------------------------------------------------------------------------
+/// @brief Registry of argument and return constructors indexed by Qt meta type
+/// id.
+///
+/// A single instance of each constructor is created when the registry is first
+/// accessed and shared by all the wrappers; looking up the constructor for
+/// a type is a single hash table access.
+class ArgConstructorRegistry {
+public:
+    /// Return registry instance.
+    static const ArgConstructorRegistry& Instance() {
+        static const ArgConstructorRegistry registry;
+        return registry;
     }
-    void Push( lua_State* L ) const {
-        StringListToLuaTable( l_, L );
+    /// Return argument constructor for meta type id or NULL if type not supported.
+    const QArgConstructor* QArg( int typeId ) const {
+        return qargs_.value( typeId, 0 );
     }
-    void Push( lua_State* L, void* value ) const {
-        StringListToLuaTable( *reinterpret_cast< QStringList* >( value ), L );
+    /// Return return value constructor for meta type id or NULL if type not
+    /// supported.
+    const LArgConstructor* LArg( int typeId ) const {
+        return largs_.value( typeId, 0 );
     }
-    StringListLArgConstructor* Clone() const {
-        return new StringListLArgConstructor( *this );
+    /// Delete constructors.
+    ~ArgConstructorRegistry() {
+        qDeleteAll( qargs_ );
+        qDeleteAll( largs_ );
     }
-    QMetaType::Type Type() const { return QMetaType::Type( QMetaType::type( TypeName< QList< QString > >() ) ); }
 private:
-    QStringList l_;
+    /// Register constructors for all the supported types; list and vector
+    /// types are registered into Qt's meta-type environment as well.
+    ArgConstructorRegistry() {
+        Add< IntQArgConstructor, IntLArgConstructor >( QMetaType::Int );
+        Add< DoubleQArgConstructor, DoubleLArgConstructor >( QMetaType::Double );
+        Add< FloatQArgConstructor, FloatLArgConstructor >( QMetaType::Float );
+        Add< StringQArgConstructor, StringLArgConstructor >( QMetaType::QString );
+        Add< VariantMapQArgConstructor, VariantMapLArgConstructor >( QMetaType::QVariantMap );
+        Add< VariantListQArgConstructor, VariantListLArgConstructor >( QMetaType::QVariantList );
+        Add< ObjectStarQArgConstructor, ObjectStarLArgConstructor >( QMetaType::QObjectStar );
+        Add< StringListQArgConstructor, StringListLArgConstructor >( QMetaType::QStringList );
+        Add< WidgetStarQArgConstructor, WidgetStarLArgConstructor >( QMetaType::QWidgetStar );
+        Add< VoidStarQArgConstructor, VoidStarLArgConstructor >( QMetaType::VoidStar );
+        Add< ListQArgConstructor< double >, ListLArgConstructor< double > >(
+            qRegisterMetaType< QList< double > >( QLUA_LIST_FLOAT64 ) );
+        Add< ListQArgConstructor< float >, ListLArgConstructor< float > >(
+            qRegisterMetaType< QList< float > >( QLUA_LIST_FLOAT32 ) );
+        Add< ListQArgConstructor< int >, ListLArgConstructor< int > >(
+            qRegisterMetaType< QList< int > >( QLUA_LIST_INT ) );
+        Add< ListQArgConstructor< short >, ListLArgConstructor< short > >(
+            qRegisterMetaType< QList< short > >( QLUA_LIST_SHORT ) );
+        Add< VectorQArgConstructor< double >, VectorLArgConstructor< double > >(
+            qRegisterMetaType< QVector< double > >( QLUA_VECTOR_FLOAT64 ) );
+        Add< VectorQArgConstructor< float >, VectorLArgConstructor< float > >(
+            qRegisterMetaType< QVector< float > >( QLUA_VECTOR_FLOAT32 ) );
+        Add< VectorQArgConstructor< int >, VectorLArgConstructor< int > >(
+            qRegisterMetaType< QVector< int > >( QLUA_VECTOR_INT ) );
+        Add< VectorQArgConstructor< short >, VectorLArgConstructor< short > >(
+            qRegisterMetaType< QVector< short > >( QLUA_VECTOR_SHORT ) );
+        // QList<QString> gets its own meta type id, distinct from QStringList's,
+        // and no constructor: parameters must be declared as QStringList
+        qRegisterMetaType< QList< QString > >( QLUA_STRING_LIST );
+        Add< TableRefQArgConstructor, TableRefLArgConstructor >(
+            qRegisterMetaType< LuaTableRef >( QLUA_TABLE_REF ) );
+        largs_.insert( QMetaType::Void, new VoidLArgConstructor );
+    }
+    /// Add constructors for type id.
+    template < typename QC, typename LC >
+    void Add( int typeId ) {
+        qargs_.insert( typeId, new QC );
+        largs_.insert( typeId, new LC );
+    }
+    ArgConstructorRegistry( const ArgConstructorRegistry& );
+    ArgConstructorRegistry& operator=( const ArgConstructorRegistry& );
+private:
+    /// Argument constructors.
+    QHash< int, const QArgConstructor* > qargs_;
+    /// Return value constructors.
+    QHash< int, const LArgConstructor* > largs_;
+};
+
+//------------------------------------------------------------------------------
+/// Alignment unit of per-call argument storage.
+union ArgStorageAlign {
+    double d_;
+    long long ll_;
+    void* p_;
+};
+
+/// Round size up to a multiple of the argument storage alignment.
+inline size_t AlignArgSize( size_t size ) {
+    return ( size + sizeof( ArgStorageAlign ) - 1 )
+           / sizeof( ArgStorageAlign ) * sizeof( ArgStorageAlign );
+}
+
+#ifndef QLUA_ARG_STORAGE_SIZE
+/// Size in bytes of the argument storage allocated on the C++ stack; methods
+/// requiring more storage use heap memory.
+#define QLUA_ARG_STORAGE_SIZE 256
+#endif
+
+/// @brief Per-call memory where arguments and return values are created
+/// at method invocation time.
+///
+/// Memory is allocated on the stack unless the requested size exceeds
+/// @c QLUA_ARG_STORAGE_SIZE.
+class ArgStorage {
+public:
+    /// Constructor.
+    /// @param size storage size, computed from method signature with AlignArgSize
+    explicit ArgStorage( size_t size )
+        : mem_( size <= sizeof( buffer_ ) ? buffer_
+                : new ArgStorageAlign[ AlignArgSize( size ) / sizeof( ArgStorageAlign ) ] ) {}
+    /// Return memory location at offset.
+    void* At( size_t offset ) { return reinterpret_cast< char* >( mem_ ) + offset; }
+    /// Destructor: release heap memory if used.
+    ~ArgStorage() { if( mem_ != buffer_ ) delete [] mem_; }
+private:
+    ArgStorage( const ArgStorage& );
+    ArgStorage& operator=( const ArgStorage& );
+private:
+    /// Stack memory.
+    ArgStorageAlign buffer_[ QLUA_ARG_STORAGE_SIZE / sizeof( ArgStorageAlign ) ];
+    /// Memory in use: either buffer_ or heap.
+    ArgStorageAlign* mem_;
 };
 
 //------------------------------------------------------------------------------
@@ -695,73 +827,57 @@ private:
 /// Whenever a new QObject is added to the Lua context, the signature of each
 /// method is translated to an index and a list of QArgWrapper objects 
 /// stored inside a LuaContext instance.
-/// At invocation time the proper method is invoked through a call to
-/// @c QMetaMethod::invoke passing the arguments returned by the QArgWrapper::Arg
-/// method invoked on each parameter in the argument list.
-/// QArgWrapper stores an instance of QArgConstructor used to create a
-/// QGenericArgument from values on the Lua stack.
+/// At invocation time the values returned by the QArgWrapper::Arg method
+/// invoked on each parameter in the argument list are passed to
+/// @c QMetaObject::metacall, or to @c QMetaMethod::invoke when direct
+/// invocation is disabled and the method has at most ten parameters.
+/// QArgWrapper references the QArgConstructor registered for the parameter type
+/// and used to create a QGenericArgument from values on the Lua stack.
 class QArgWrapper {
 public:
     /// @brief Default constructor.
     QArgWrapper() : ac_( 0 ) {}
-    /// Copy constructor: Clone QArgConstructor instance.
-    QArgWrapper( const QArgWrapper& other ) : ac_( 0 ) {
-        if( other.ac_ ) ac_ = other.ac_->Clone();
-    }
-    /// @brief Construct instance from type name. Creates proper instance of
-    /// inner QArgConstructor from type info.
-    QArgWrapper( const QString& type ) : ac_( 0 ) {
-        if( type == QMetaType::typeName( QMetaType::Int ) ) {
-            ac_ = new IntQArgConstructor;
-        } else if( type == QMetaType::typeName( QMetaType::Double ) ) {
-            ac_ = new DoubleQArgConstructor;
-        } else if( type == QMetaType::typeName( QMetaType::Float ) ) {
-            ac_ = new FloatQArgConstructor;
-        } else if( type == QMetaType::typeName( QMetaType::QString ) ) {
-            ac_ = new StringQArgConstructor;
-        } else if( type == QMetaType::typeName( QMetaType::QVariantMap ) ) {
-            ac_ = new VariantMapQArgConstructor;
-        } else if( type == QMetaType::typeName( QMetaType::QVariantList ) ) {
-            ac_ = new VariantListQArgConstructor;
-        } else if( type == QMetaType::typeName( QMetaType::QObjectStar ) ) {
-            ac_ = new ObjectStarQArgConstructor;
-        } else if( type == QMetaType::typeName( QMetaType::QStringList ) ) {
-            ac_ = new StringListQArgConstructor;
-        } else if( type == QMetaType::typeName( QMetaType::QWidgetStar ) ) {
-            ac_ = new WidgetStarQArgConstructor;
-        } else if( type == QMetaType::typeName( QMetaType::VoidStar ) ) {
-            ac_ = new VoidStarQArgConstructor;
-        } else if( type == QLUA_LIST_FLOAT64 ) {
-            ac_ = new ListQArgConstructor< double >;
-        } else if( type == QLUA_LIST_FLOAT32 ) {
-            ac_ = new ListQArgConstructor< float >;
-        } else if( type == QLUA_LIST_INT ) {
-            ac_ = new ListQArgConstructor< int >;
-        } else if( type == QLUA_LIST_SHORT ) {
-            ac_ = new ListQArgConstructor< short >;
-        } else if( type == QLUA_VECTOR_FLOAT64 ) {
-            ac_ = new VectorQArgConstructor< double >;
-        } else if( type == QLUA_VECTOR_FLOAT32 ) {
-            ac_ = new VectorQArgConstructor< float >;
-        } else if( type == QLUA_VECTOR_INT ) {
-            ac_ = new VectorQArgConstructor< int >;
-        } else if( type == QLUA_VECTOR_SHORT ) {
-            ac_ = new VectorQArgConstructor< short >;
-        } else throw std::logic_error( ( "Type " + type + " unknown" ).toStdString() );
+    /// @brief Construct instance from type name. Looks up the QArgConstructor
+    /// registered for the type; if the type is not supported the wrapper is
+    /// invalid and IsValid() returns @c false.
+    QArgWrapper( const QByteArray& type ) : ac_( 0 ), type_( type ) {
+        const int id = QMetaType::type( type.constData() );
+        if( id != QMetaType::Void ) ac_ = ArgConstructorRegistry::Instance().QArg( id );
+    }
+    /// Return @c true if type is supported.
+    bool IsValid() const { return ac_ != 0; }
+    /// Type name.
+    const QByteArray& Type() const { return type_; }
+    /// @brief Raise a Lua error if the value on the Lua stack cannot be converted.
+    void Check( lua_State* L, int idx ) const {
+        if( ac_ ) ac_->Check( L, idx );
+    }
+    /// @brief Return match score of Lua type; see QArgConstructor::Score.
+    int Score( int luaType ) const {
+        return ac_ ? ac_->Score( luaType ) : 1;
     }
     /// @brief Return QGenericArgument instance created from values on the Lua stack.
     ///
     /// Internally it calls QArgConstructor::Create to generate QGenericArguments from
-    /// Lua values.
-    QGenericArgument Arg( lua_State* L, int idx ) const {
-        return ac_ ? ac_->Create( L, idx ) : QGenericArgument();
-    }
-    /// @brief Destructor; delete QArgConstructor instance.
-    ~QArgWrapper() { delete ac_; }
+    /// Lua values; no Lua error is raised.
+    /// @param L Lua state
+    /// @param idx position of value in Lua stack
+    /// @param p memory location where value is created; must be at least Size() bytes
+    /// @return argument with null data if the value cannot be converted
+    QGenericArgument Arg( lua_State* L, int idx, void* p ) const {
+        return ac_ ? ac_->Create( L, idx, p ) : QGenericArgument();
+    }
+    /// Destroy value created by Arg.
+    void Destroy( void* p ) const {
+        if( ac_ ) ac_->Destroy( p );
+    }
+    /// Size of value created by Arg.
+    size_t Size() const { return ac_ ? ac_->Size() : 0; }
 private:
-    /// Instance of QArgConstructor created from type information at construction
-    /// time.
-    QArgConstructor* ac_;    
+    /// QArgConstructor instance registered for the parameter type; not owned.
+    const QArgConstructor* ac_;
+    /// Qt type name.
+    QByteArray type_;
 };
 
 /// @brief Wrapper for objects returned from QObject method invocation or passes
@@ -775,63 +891,23 @@ class LArgWrapper {
 public:
     ///@brief Default constructor.
     LArgWrapper() : ac_( 0 ) {}
-    ///@brief Copy constructor: Clones the internal Return constructor instance.
-    LArgWrapper( const LArgWrapper& other ) : ac_( 0 ), type_( other.type_ ) {
-        if( other.ac_ ) ac_ = other.ac_->Clone();
-    }
     ///@brief Create instance from type name.
     ///
-    ///An instance of LArgConstructor is created from the passes type name.
-    LArgWrapper( const QString& type ) : ac_( 0 ), type_( type ) {
-        if( type_ == QMetaType::typeName( QMetaType::Int ) ) {
-            ac_ = new IntLArgConstructor;
-        } else if( type == QMetaType::typeName( QMetaType::Double ) ) {
-            ac_ = new DoubleLArgConstructor;
-        } else if( type == QMetaType::typeName( QMetaType::Float ) ) {
-            ac_ = new FloatLArgConstructor;
-        } else if( type_ == QMetaType::typeName( QMetaType::QString ) ) {
-            ac_ = new StringLArgConstructor;
-        } else if( type_ == QMetaType::typeName( QMetaType::QVariantMap ) ) {
-            ac_ = new VariantMapLArgConstructor;
-        } else if( type_ == QMetaType::typeName( QMetaType::QVariantList ) ) {
-            ac_ = new VariantListLArgConstructor;
-        } else if( type == QMetaType::typeName( QMetaType::QObjectStar ) ) {
-            ac_ = new ObjectStarLArgConstructor;
-        } else if( type == QMetaType::typeName( QMetaType::QStringList ) ) {
-            ac_ = new StringListLArgConstructor;
-        } else if( type == QMetaType::typeName( QMetaType::QWidgetStar ) ) {
-            ac_ = new WidgetStarLArgConstructor;
-        } else if( type == QMetaType::typeName( QMetaType::VoidStar ) ) {
-            ac_ = new VoidStarLArgConstructor;
-        } else if( type == QLUA_LIST_FLOAT64 ) {
-            ac_ = new ListLArgConstructor< double >;
-        } else if( type == QLUA_LIST_FLOAT32 ) {
-            ac_ = new ListLArgConstructor< float >;
-        } else if( type == QLUA_LIST_INT ) {
-            ac_ = new ListLArgConstructor< int >;
-        } else if( type == QLUA_LIST_SHORT ) {
-            ac_ = new ListLArgConstructor< short >;
-        } else if( type == QLUA_VECTOR_FLOAT64 ) {
-            ac_ = new VectorLArgConstructor< double >;
-        } else if( type == QLUA_VECTOR_FLOAT32 ) {
-            ac_ = new VectorLArgConstructor< float >;
-        } else if( type == QLUA_VECTOR_INT ) {
-            ac_ = new VectorLArgConstructor< int >;
-        } else if( type == QLUA_VECTOR_SHORT ) {
-            ac_ = new VectorLArgConstructor< short >;
-        } else if( type_.isEmpty() ) ac_ = new VoidLArgConstructor;
-        else throw std::logic_error( ( "Type " + type + " unknown" ).toStdString() );
-    }
-    /// @brief Push values stored in the inner LArgConstructor instance on the
-    /// Lua stack.
-    ///
-    /// This is the method invoked to return values from a QObject method invocation.
-    void Push( lua_State* L ) const {
-        ac_->Push( L );
+    ///The LArgConstructor registered for the type is looked up; an empty
+    ///type name identifies a @c void return type; if the type is not supported
+    ///the wrapper is invalid and IsValid() returns @c false.
+    LArgWrapper( const QByteArray& type ) : ac_( 0 ), type_( type ) {
+        const int id = QMetaType::type( type.constData() );
+        if( id != QMetaType::Void || type.isEmpty() ) {
+            ac_ = ArgConstructorRegistry::Instance().LArg( id );
+        }
     }
-    /// @brief Push values stored in passed memory location on the Lua stack.
+    /// Return @c true if type is supported.
+    bool IsValid() const { return ac_ != 0; }
+    /// @brief Push value stored in passed memory location on the Lua stack.
     ///
-    /// This is the method invoked when a Lua callback is called through
+    /// This is the method invoked to return values from a QObject method
+    /// invocation and when a Lua callback is called through
     /// @c QObject::qt_metacall (e.g. through a triggered signal). When Lua 
     /// functions are called through @c qt_metacall the list of arguments is stored 
     /// inside an array of void pointers; each parameter must therefore be converted to 
@@ -839,32 +915,38 @@ public:
     /// @param L Lua state
     /// @param value memory location to read from
     void Push( lua_State* L, void* value ) const {
-        ac_->Push( L, value ); // called from the callback dispatcher method
+        ac_->Push( L, value );
     }
-    /// @brief Return the location where the return argument passed to a method
-    /// invocation shall be stored.
+    /// @brief Create default value at the passed memory location and return
+    /// a QGenericReturnArgument referencing it.
     ///
-    /// This method is invoked to provide QMetaMethod::invoke with the location
-    /// where the return value will be stored, which is the storage space provided
-    /// by the LArgConstructor instance stored in instances of this class.
-    /// After the method invocation returns the value in the LArgConstructor instance
-    /// is pushed on the Lua stack through a call to LArgConstructor::Push(lua_State*).
-    QGenericReturnArgument Arg() const { return ac_->Argument(); }
+    /// This method is invoked to provide the invoked method with the location
+    /// where the return value will be stored, which is part of the per-call
+    /// memory reserved by the invoking function.
+    /// After the method invocation returns the value is pushed on the Lua stack
+    /// through a call to LArgWrapper::Push(lua_State*, void*) and destroyed
+    /// through a call to LArgWrapper::Destroy.
+    QGenericReturnArgument Arg( void* p ) const {
+        ac_->Construct( p );
+        return QGenericReturnArgument( type_.constData(), p );
+    }
+    /// Destroy value created by Arg.
+    void Destroy( void* p ) const { ac_->Destroy( p ); }
+    /// Size of value created by Arg.
+    size_t Size() const { return ac_ ? ac_->Size() : 0; }
     /// Type name.
-    const QString& Type() const { 
+    const QByteArray& Type() const {
         return type_;
     }
     /// Meta type.
     QMetaType::Type MetaType() const { return ac_->Type(); }
     /// Return true if wrapped type is QObject pointer.
     bool IsQObjectPtr() const { return ac_->IsQObjectPtr(); }
-    /// Delete LArgConstructor instance.
-    ~LArgWrapper() { delete ac_; }
 private:
-    /// LArgConstructor instance created at construction time.
-    LArgConstructor* ac_;
+    /// LArgConstructor instance registered for the type; not owned.
+    const LArgConstructor* ac_;
     /// Qt type name of data stored in ac_.
-    QString type_;
+    QByteArray type_;
 };
 
 typedef QList< QArgWrapper > QArgWrappers;
@@ -880,7 +962,7 @@ inline QArgWrappers GenerateQArgWrappers( const ArgumentTypes& at ) {
     return aw;
 }
 /// @brief Create LArgWrapper instance from type name.
-inline LArgWrapper GenerateLArgWrapper( const QString& typeName ) {
+inline LArgWrapper GenerateLArgWrapper( const QByteArray& typeName ) {
     return LArgWrapper( typeName );
 }
 
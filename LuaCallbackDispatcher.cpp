@@ -30,88 +30,1062 @@ extern "C" {
 }
 
 
+#include <cstring>
+
+#include <QTimerEvent>
+#include <QEvent>
+#include <QThread>
+#include <QMutexLocker>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QVarLengthArray>
+
 #include "LuaContext.h"
 #include "LuaCallbackDispatcher.h"
 
 namespace qlua {
 
 //------------------------------------------------------------------------------
-bool LuaCallbackDispatcher::Connect( QObject *obj, 
+// Return parameter signature of signal e.g. "(int,QString)"
+static QByteArray ParameterSignature( QObject* obj, int signalIdx ) {
+    const char* signature = obj->metaObject()->method( signalIdx ).signature();
+    return QByteArray( std::strchr( signature, '(' ) );
+}
+//------------------------------------------------------------------------------
+// Return index of QObject::destroyed(QObject*) signal
+static int DestroyedSignalIndex() {
+    static const int destroyedIdx = 
+        QObject::staticMetaObject.indexOfSignal( "destroyed(QObject*)" );
+    return destroyedIdx;
+}
+//------------------------------------------------------------------------------
+// Return key identifying parameter types, used to reuse method ids only for
+// methods with the same parameter types
+static QByteArray ParameterTypesKey( const CBackParameterTypes& types ) {
+    QByteArray key;
+    for( CBackParameterTypes::const_iterator i = types.begin(); i != types.end(); ++i ) {
+        key += QByteArray::number( i->MetaType() ) + ',';
+    }
+    return key;
+}
+//------------------------------------------------------------------------------
+// Message handler: add traceback to error message through debug.traceback
+static int Traceback( lua_State* L ) {
+    if( !lua_isstring( L, 1 ) ) return 1;
+    lua_getglobal( L, "debug" );
+    if( !lua_istable( L, -1 ) ) {
+        lua_pop( L, 1 );
+        return 1;
+    }
+    lua_getfield( L, -1, "traceback" );
+    if( !lua_isfunction( L, -1 ) ) {
+        lua_pop( L, 2 );
+        return 1;
+    }
+    lua_pushvalue( L, 1 );
+    lua_pushinteger( L, 2 ); // skip this function and traceback
+    lua_call( L, 2, 1 );
+    return 1;
+}
+//------------------------------------------------------------------------------
+// Elapsed time in nanoseconds
+static qint64 Nanoseconds( const QElapsedTimer& t ) {
+#if QT_VERSION >= 0x040800
+    return t.nsecsElapsed();
+#else
+    return t.elapsed() * 1000000;
+#endif
+}
+//------------------------------------------------------------------------------
+void LuaCallbackDispatcher::PushFunctionTable( lua_State* L ) {
+    if( functionTableRef_ == LUA_NOREF ) {
+        // functions are weak keys: the table does not prevent functions
+        // from being garbage collected
+        lua_newtable( L );
+        lua_newtable( L );
+        lua_pushstring( L, "k" );
+        lua_setfield( L, -2, "__mode" );
+        lua_setmetatable( L, -2 );
+        functionTableRef_ = luaL_ref( L, LUA_REGISTRYINDEX );
+    }
+    lua_rawgeti( L, LUA_REGISTRYINDEX, functionTableRef_ );
+}
+//------------------------------------------------------------------------------
+bool LuaCallbackDispatcher::Connect( lua_State* L,
+                                     QObject *obj, 
                                      int signalIdx,
                                      const CBackParameterTypes& paramTypes,
-                                     LuaCBackRef luaCBackRef ) {
-    // check if Lua function reference already stored in database;
-    // if not create a new 'dynamic method' and map function reference
-    // to the newly created method;
-    // the index of a new method is the metod array size
-    int methodIdx = cbackToMethodIndex_.value( luaCBackRef, -1 );
+                                     int cbackStackIndex,
+                                     const DeliveryOptions& options ) {
+    if( cbackStackIndex < 0 ) cbackStackIndex = lua_gettop( L ) + cbackStackIndex + 1;
+    // methods with different delivery options are stored under different keys
+    const QByteArray signature = ParameterSignature( obj, signalIdx ) + options.Key();
+    // look up table of methods associated with function, create it if
+    // not found
+    PushFunctionTable( L );
+    lua_pushvalue( L, cbackStackIndex );
+    lua_rawget( L, -2 );
+    if( lua_isnil( L, -1 ) ) {
+        lua_pop( L, 1 );
+        lua_newtable( L );
+        lua_pushvalue( L, cbackStackIndex );
+        lua_pushvalue( L, -2 );
+        lua_rawset( L, -4 );
+    }
+    // look up method associated with signal signature; if not found create
+    // a new 'dynamic method' reusing an unused method id if available
+    lua_getfield( L, -1, signature.constData() );
+    MethodId methodIdx = lua_isnil( L, -1 ) ? -1 : MethodId( lua_tointeger( L, -1 ) );
+    lua_pop( L, 1 );
     if( methodIdx < 0 ) {
+        LuaCBackMethod* m = 0;
+        if( options.weak_ ) {
+            // weak connection: the function is referenced from a weak-valued
+            // table and a sentinel, collected together with the function,
+            // releases the method
+            PushWeakTable( L );
+            lua_pushvalue( L, cbackStackIndex );
+            const int luaCBackRef = luaL_ref( L, -2 );
+            lua_pop( L, 1 );
+            m = new LuaCBackMethod( lc_, paramTypes, luaCBackRef, signature, options,
+                                    weakTableRef_ );
+            methodIdx = AddMethod( m );
+            WeakSentinel* ws = reinterpret_cast< WeakSentinel* >( 
+                                   lua_newuserdata( L, sizeof( WeakSentinel ) ) );
+            ws->dispatcher_ = this;
+            ws->methodId_ = methodIdx;
+            ws->serial_ = m->Serial();
+            if( luaL_newmetatable( L, "qlua.WeakSentinel" ) ) {
+                lua_pushcfunction( L, &LuaCallbackDispatcher::WeakSentinelCollected );
+                lua_setfield( L, -2, "__gc" );
+            }
+            lua_setmetatable( L, -2 );
+            lua_setfield( L, -2, ( '~' + signature ).constData() );
+            sentinels_.insert( ws );
+        } else {
+            lua_pushvalue( L, cbackStackIndex );
+            const int luaCBackRef = luaL_ref( L, LUA_REGISTRYINDEX );
+            m = new LuaCBackMethod( lc_, paramTypes, luaCBackRef, signature, options );
+            methodIdx = AddMethod( m );
+        }
+        lua_pushinteger( L, methodIdx );
+        lua_setfield( L, -2, signature.constData() );
+    }
+    lua_pop( L, 2 );
+    // connect signal to method in method array; the connection is direct:
+    // emissions from other threads are queued by qt_metacall
+    LuaCBackMethod* m = luaCBackMethods_[ methodIdx ];
+    if( !QMetaObject::connect( obj, signalIdx, this,
+                               methodIdx + FIRST_CBACK_METHOD + metaObject()->methodCount(),
+                               Qt::DirectConnection ) ) {
+        if( m->Connections() == 0 ) ReleaseMethod( L, methodIdx );
+        return false;
+    }
+    m->AddConnection( obj, signalIdx );
+    // methods are released when the sender is destroyed
+    senderMethods_[ obj ].insert( methodIdx );
+    WatchObject( obj );
+    return true;
+}
+//------------------------------------------------------------------------------
+void LuaCallbackDispatcher::PushWeakTable( lua_State* L ) {
+    if( weakTableRef_ == LUA_NOREF ) {
+        lua_newtable( L );
+        lua_newtable( L );
+        lua_pushstring( L, "v" );
+        lua_setfield( L, -2, "__mode" );
+        lua_setmetatable( L, -2 );
+        weakTableRef_ = luaL_ref( L, LUA_REGISTRYINDEX );
+    }
+    lua_rawgeti( L, LUA_REGISTRYINDEX, weakTableRef_ );
+}
+//------------------------------------------------------------------------------
+int LuaCallbackDispatcher::WeakSentinelCollected( lua_State* L ) {
+    WeakSentinel* ws = reinterpret_cast< WeakSentinel* >( lua_touserdata( L, 1 ) );
+    if( !ws->dispatcher_ ) return 0;
+    ws->dispatcher_->sentinels_.remove( ws );
+    ws->dispatcher_->ReleaseCollected( L, ws->methodId_, ws->serial_ );
+    return 0;
+}
+//------------------------------------------------------------------------------
+// Invoked when the sentinel of a weak connection is collected: the method is
+// not released if it was already released through a disconnect operation,
+// possibly recycling its id
+void LuaCallbackDispatcher::ReleaseCollected( lua_State* L, MethodId methodIdx, unsigned serial ) {
+    if( !lc_ || methodIdx >= luaCBackMethods_.size() ) return;
+    LuaCBackMethod* m = luaCBackMethods_[ methodIdx ];
+    if( !m || m->Serial() != serial ) return;
+    typedef QList< QPair< QObject*, int > > Sources;
+    const Sources sources = m->Sources();
+    for( Sources::const_iterator i = sources.begin(); i != sources.end(); ++i ) {
+        QMetaObject::disconnect( i->first, i->second, this,
+                                 methodIdx + FIRST_CBACK_METHOD + metaObject()->methodCount() );
+    }
+    ReleaseMethod( L, methodIdx );
+}
+//------------------------------------------------------------------------------
+void LuaCallbackDispatcher::ReleaseSenderMethods( QObject* obj ) {
+    const QSet< MethodId > ids = senderMethods_.take( obj );
+    if( !lc_ ) return;
+    // connections are removed by Qt
+    for( QSet< MethodId >::const_iterator i = ids.begin(); i != ids.end(); ++i ) {
+        LuaCBackMethod* m = *i < luaCBackMethods_.size() ? luaCBackMethods_[ *i ] : 0;
+        if( !m ) continue;
+        m->RemoveSender( obj );
+        if( m->Connections() == 0 ) ReleaseMethod( lc_->LuaState(), *i );
+    }
+}
+//------------------------------------------------------------------------------
+MethodId LuaCallbackDispatcher::AddMethod( LuaCBackMethod* m ) {
+    m->SetSerial( nextSerial_++ );
+    const QByteArray types = ParameterTypesKey( m->ParameterTypes() );
+    QMutexLocker lock( &methodsMutex_ );
+    MethodId methodIdx = -1;
+    QHash< QByteArray, QList< MethodId > >::iterator f = freeMethodIds_.find( types );
+    if( f == freeMethodIds_.end() ) {
         methodIdx = luaCBackMethods_.size();
-        cbackToMethodIndex_[ luaCBackRef ] = methodIdx;
-        luaCBackMethods_.push_back(
-            new LuaCBackMethod( lc_, paramTypes, luaCBackRef ) );
+        luaCBackMethods_.push_back( m );
+    } else {
+        methodIdx = f->takeLast();
+        if( f->isEmpty() ) freeMethodIds_.erase( f );
+        luaCBackMethods_[ methodIdx ] = m;
+    }
+    return methodIdx;
 }
-    // connect signal to method in method array
-    return QMetaObject::connect( obj, signalIdx, this, methodIdx + metaObject()->methodCount() );
+//------------------------------------------------------------------------------
+bool LuaCallbackDispatcher::Wait( lua_State* L,
+                                  QObject* obj,
+                                  int signalIdx,
+                                  const CBackParameterTypes& paramTypes ) {
+    // a previous waiter is left if the coroutine did not yield, e.g. when
+    // qlua.wait is called through pcall with Lua 5.1: only the last waiter
+    // resumes the coroutine
+    PushWaitTable( L );
+    lua_pushthread( L );
+    lua_rawget( L, -2 );
+    if( lua_isnumber( L, -1 ) ) ReleaseWaiter( L, MethodId( lua_tointeger( L, -1 ) ) );
+    lua_pop( L, 2 );
+    // the reference to the coroutine prevents it from being garbage collected
+    // while waiting
+    lua_pushthread( L );
+    const int threadRef = luaL_ref( L, LUA_REGISTRYINDEX );
+    LuaCBackMethod* m = new LuaCBackMethod( lc_, paramTypes, threadRef, QByteArray() );
+    m->SetWaiter( true );
+    const MethodId methodIdx = AddMethod( m );
+    if( !QMetaObject::connect( obj, signalIdx, this,
+                               methodIdx + FIRST_CBACK_METHOD + metaObject()->methodCount(),
+                               Qt::DirectConnection ) ) {
+        ReleaseMethod( L, methodIdx );
+        return false;
+    }
+    m->AddConnection( obj, signalIdx );
+    senderMethods_[ obj ].insert( methodIdx );
+    WatchObject( obj );
+    PushWaitTable( L );
+    lua_pushthread( L );
+    lua_pushinteger( L, methodIdx );
+    lua_rawset( L, -3 );
+    lua_pop( L, 1 );
+    return true;
+}
+//------------------------------------------------------------------------------
+void LuaCallbackDispatcher::PushWaitTable( lua_State* L ) {
+    if( waitTableRef_ == LUA_NOREF ) {
+        lua_newtable( L );
+        waitTableRef_ = luaL_ref( L, LUA_REGISTRYINDEX );
+    }
+    lua_rawgeti( L, LUA_REGISTRYINDEX, waitTableRef_ );
+}
+//------------------------------------------------------------------------------
+void LuaCallbackDispatcher::WaitReturned( lua_State* L ) {
+    PushWaitTable( L );
+    lua_pushthread( L );
+    lua_rawget( L, -2 );
+    const bool waiting = lua_isnumber( L, -1 ) != 0;
+    const MethodId methodIdx = MethodId( lua_tointeger( L, -1 ) );
+    lua_pop( L, 2 );
+    if( waiting ) ReleaseWaiter( L, methodIdx );
+}
+//------------------------------------------------------------------------------
+bool LuaCallbackDispatcher::SuspendedInWait( lua_State* co ) const {
+    // level 0 is the yielding C function, whose stack frame is not reliable
+    // while suspended, level 1 the Lua function exposed as qlua.wait
+    lua_Debug ar;
+    if( !lua_getstack( co, 1, &ar ) || !lua_checkstack( co, 2 ) ) return false;
+    lua_getinfo( co, "f", &ar );
+    lua_rawgeti( co, LUA_REGISTRYINDEX, lc_->waitFunctionRef_ );
+    const bool waiting = lua_rawequal( co, -1, -2 ) != 0;
+    lua_pop( co, 2 );
+    return waiting;
+}
+//------------------------------------------------------------------------------
+// precondition: Lua function available in lua stack
+bool LuaCallbackDispatcher::ConnectHandler( lua_State* L,
+                                            QObject* obj,
+                                            int signalIdx,
+                                            const CBackParameterTypes& paramTypes,
+                                            int cbackStackIndex,
+                                            int priority ) {
+    if( cbackStackIndex < 0 ) cbackStackIndex = lua_gettop( L ) + cbackStackIndex + 1;
+    // a single multicast method is connected to each signal, the method
+    // references an array of handlers
+    const QPair< QObject*, int > source( obj, signalIdx );
+    QHash< QPair< QObject*, int >, MethodId >::const_iterator g = 
+        multicastMethods_.find( source );
+    if( g == multicastMethods_.end() ) {
+        lua_newtable( L );
+        const int handlersRef = luaL_ref( L, LUA_REGISTRYINDEX );
+        LuaCBackMethod* m = new LuaCBackMethod( lc_, paramTypes, handlersRef,
+                                                ParameterSignature( obj, signalIdx ) );
+        m->SetMulticast( true );
+        const MethodId methodIdx = AddMethod( m );
+        if( !QMetaObject::connect( obj, signalIdx, this,
+                                   methodIdx + FIRST_CBACK_METHOD + metaObject()->methodCount(),
+                                   Qt::DirectConnection ) ) {
+            ReleaseMethod( L, methodIdx );
+            return false;
+        }
+        m->AddConnection( obj, signalIdx );
+        senderMethods_[ obj ].insert( methodIdx );
+        WatchObject( obj );
+        g = multicastMethods_.insert( source, methodIdx );
+        multicastSources_.insert( methodIdx, source );
+    }
+    luaCBackMethods_[ *g ]->AddHandler( L, cbackStackIndex, priority );
+    return true;
 }
 //------------------------------------------------------------------------------
 // precondition: Lua function available in lua stack
-bool LuaCallbackDispatcher::Disconnect( QObject *obj, 
+bool LuaCallbackDispatcher::Disconnect( lua_State* L,
+                                        QObject *obj, 
                                         int signalIdx,
                                         int cbackStackIndex ) {
-    if( !lua_isfunction( lc_->LuaState(), cbackStackIndex ) ) {
-        RaiseLuaError( lc_->LuaState(), "No function to disconnect found" );
+    if( !lua_isfunction( L, cbackStackIndex ) ) {
+        RaiseLuaError( L, "No function to disconnect found" );
         return false;
-	}
-    int m = 0;
-    bool ok = true;
-    // iterate over callback methods, each method is associated with
-    // one and only one Lua function
-    for( QList< LuaCBackMethod* >::iterator i = luaCBackMethods_.begin();
-          i != luaCBackMethods_.end(); ++i, ++m ) {
-         // get lua function associated with lua reference
-         lua_rawgeti( lc_->LuaState(), LUA_REGISTRYINDEX, ( *i )->CBackRef() );
-         if( cbackStackIndex < 0 ) --cbackStackIndex;
-         // compare function with Lua function to disconnect
-#if LUA_VERSION_NUM > 501
-         const bool same = lua_compare( lc_->LuaState(), cbackStackIndex, -1, LUA_OPEQ );
-#else
-         const bool same = lua_equal( lc_->LuaState(), cbackStackIndex, -1 );
-#endif
-         // if match disconnect signal from method and remove reference
-         if( same ) {
-             ok = ok && QMetaObject::disconnect( obj, signalIdx, this, m + metaObject()->methodCount() );
-             luaL_unref( lc_->LuaState(), LUA_REGISTRYINDEX, lua_tointeger( lc_->LuaState(), -1 ) );
-             lua_pop( lc_->LuaState(), 1 );
-         } else lua_pop( lc_->LuaState(), 1 );
-    }   
+    }
+    if( cbackStackIndex < 0 ) cbackStackIndex = lua_gettop( L ) + cbackStackIndex + 1;
+    const QByteArray signature = ParameterSignature( obj, signalIdx );
+    // collect the methods associated with the signal signature under any
+    // delivery options: keys are the signature optionally followed by '|'
+    QList< MethodId > methodIds;
+    PushFunctionTable( L );
+    lua_pushvalue( L, cbackStackIndex );
+    lua_rawget( L, -2 );
+    if( lua_istable( L, -1 ) ) {
+        lua_pushnil( L );
+        while( lua_next( L, -2 ) ) {
+            size_t len = 0;
+            const char* key = lua_tolstring( L, -2, &len );
+            if( len >= size_t( signature.size() )
+                && std::strncmp( key, signature.constData(), signature.size() ) == 0
+                && ( key[ signature.size() ] == '\0' || key[ signature.size() ] == '|' ) ) {
+                methodIds.push_back( MethodId( lua_tointeger( L, -1 ) ) );
+            }
+            lua_pop( L, 1 );
+        }
+    }
+    lua_pop( L, 2 );
+    // all the connections from the signal to the methods are removed
+    bool ok = false;
+    QHash< QPair< QObject*, int >, MethodId >::const_iterator g =
+        multicastMethods_.find( qMakePair( obj, signalIdx ) );
+    if( g != multicastMethods_.end() ) {
+        const MethodId methodIdx = *g;
+        LuaCBackMethod* m = luaCBackMethods_[ methodIdx ];
+        ok = m->RemoveHandler( L, cbackStackIndex ) > 0;
+        if( m->Handlers() == 0 ) {
+            QMetaObject::disconnect( obj, signalIdx, this,
+                                     methodIdx + FIRST_CBACK_METHOD + metaObject()->methodCount() );
+            ReleaseMethod( L, methodIdx );
+        }
+    }
+    for( QList< MethodId >::const_iterator i = methodIds.begin(); i != methodIds.end(); ++i ) {
+        ok = QMetaObject::disconnect( obj, signalIdx, this,
+                                      *i + FIRST_CBACK_METHOD + metaObject()->methodCount() ) || ok;
+        LuaCBackMethod* m = luaCBackMethods_[ *i ];
+        m->RemoveConnections( obj, signalIdx );
+        if( m->Connections() == 0 ) ReleaseMethod( L, *i );
+        else if( !m->HasSender( obj ) ) {
+            QHash< QObject*, QSet< MethodId > >::iterator s = senderMethods_.find( obj );
+            if( s != senderMethods_.end() ) {
+                s->remove( *i );
+                if( s->isEmpty() ) senderMethods_.erase( s );
+            }
+        }
+    }
     return ok;
 }
 //------------------------------------------------------------------------------
+void LuaCallbackDispatcher::ReleaseMethod( lua_State* L, MethodId methodIdx ) {
+    LuaCBackMethod* m = luaCBackMethods_[ methodIdx ];
+    // remove method id from the function's table and remove the function's
+    // table if empty; waiters are not stored in the function table and the
+    // table of a collected weak function is not reachable anymore;
+    // multicast methods are stored in a separate map
+    if( m->IsMulticast() ) {
+        multicastMethods_.remove( multicastSources_.take( methodIdx ) );
+    } else if( !m->IsWaiter() ) {
+        PushFunctionTable( L );
+        m->PushCallback( L );
+        lua_rawget( L, -2 );
+        if( lua_istable( L, -1 ) ) {
+            lua_pushnil( L );
+            lua_setfield( L, -2, m->Key().constData() );
+            lua_pushnil( L );
+            lua_setfield( L, -2, ( '~' + m->Key() ).constData() );
+            lua_pushnil( L );
+            if( lua_next( L, -2 ) ) lua_pop( L, 2 );
+            else {
+                m->PushCallback( L );
+                lua_pushnil( L );
+                lua_rawset( L, -4 );
+            }
+        }
+        lua_pop( L, 2 );
+    } else {
+        // remove the coroutine's entry from the wait table if this is its
+        // last waiter
+        PushWaitTable( L );
+        lua_rawgeti( L, LUA_REGISTRYINDEX, m->CBackRef() );
+        lua_pushvalue( L, -1 );
+        lua_rawget( L, -3 );
+        const bool last = lua_isnumber( L, -1 ) && lua_tointeger( L, -1 ) == methodIdx;
+        lua_pop( L, 1 );
+        if( last ) {
+            lua_pushnil( L );
+            lua_rawset( L, -3 );
+            lua_pop( L, 1 );
+        } else lua_pop( L, 2 );
+    }
+    if( m->WeakTableRef() != LUA_NOREF ) {
+        lua_rawgeti( L, LUA_REGISTRYINDEX, m->WeakTableRef() );
+        luaL_unref( L, -1, m->CBackRef() );
+        lua_pop( L, 1 );
+    } else luaL_unref( L, LUA_REGISTRYINDEX, m->CBackRef() );
+    // remove method from the lists of methods connected to senders
+    typedef QList< QPair< QObject*, int > > Sources;
+    const Sources sources = m->Sources();
+    for( Sources::const_iterator i = sources.begin(); i != sources.end(); ++i ) {
+        QHash< QObject*, QSet< MethodId > >::iterator s = senderMethods_.find( i->first );
+        if( s == senderMethods_.end() ) continue;
+        s->remove( methodIdx );
+        if( s->isEmpty() ) senderMethods_.erase( s );
+    }
+    // queued emissions are discarded
+    if( m->TimerId() ) {
+        killTimer( m->TimerId() );
+        flushTimers_.remove( m->TimerId() );
+    }
+    // the method is removed from the array before being deleted: other
+    // threads access methods only through the array, under lock
+    const QByteArray types = ParameterTypesKey( m->ParameterTypes() );
+    {
+        QMutexLocker lock( &methodsMutex_ );
+        luaCBackMethods_[ methodIdx ] = 0;
+        freeMethodIds_[ types ].push_back( methodIdx );
+    }
+    m->Release();
+}
+//------------------------------------------------------------------------------
+void LuaCallbackDispatcher::WatchObject( QObject* obj ) {
+    if( watchedObjects_.contains( obj ) ) return;
+    QMetaObject::connect( obj, DestroyedSignalIndex(), this,
+                          OBJECT_DESTROYED_METHOD + metaObject()->methodCount() );
+    watchedObjects_.insert( obj );
+}
+//------------------------------------------------------------------------------
 int LuaCallbackDispatcher::qt_metacall( QMetaObject::Call invoke, MethodId methodIndex, void **arguments ) {
     methodIndex = QObject::qt_metacall( invoke, methodIndex, arguments );
     if( methodIndex < 0 || invoke != QMetaObject::InvokeMetaMethod ) return methodIndex;
-    luaCBackMethods_[ methodIndex ]->Invoke( arguments );
+    if( methodIndex == OBJECT_DESTROYED_METHOD ) {
+        QObject* obj = *reinterpret_cast< QObject** >( arguments[ 1 ] );
+        watchedObjects_.remove( obj );
+        if( lc_ ) lc_->QObjectDestroyed( obj );
+        ReleaseSenderMethods( obj );
+        return -1;
+    }
+    methodIndex -= FIRST_CBACK_METHOD;
+    // the Lua state is only accessed from the thread of the dispatcher
+    if( QThread::currentThread() != thread() ) Enqueue( methodIndex, arguments );
+    else Deliver( methodIndex, arguments );
     return -1;
 }
 //------------------------------------------------------------------------------
+void LuaCallbackDispatcher::Deliver( MethodId methodIndex, void** arguments ) {
+    // methods released after a signal was queued are not invoked
+    if( methodIndex >= luaCBackMethods_.size() || !luaCBackMethods_[ methodIndex ] ) return;
+    LuaCBackMethod* m = luaCBackMethods_[ methodIndex ];
+    if( m->IsWaiter() ) {
+        Resume( methodIndex, arguments );
+    } else if( m->Options().mode_ == DeliveryOptions::DELIVER_IMMEDIATE ) {
+        m->Invoke( arguments );
+    } else if( m->Queue( arguments ) ) {
+        FlushMethod( methodIndex );
+    } else if( !m->TimerId() ) {
+        m->SetTimerId( startTimer( m->Options().interval_ ) );
+        flushTimers_[ m->TimerId() ] = methodIndex;
+    }
+}
+//------------------------------------------------------------------------------
+void LuaCallbackDispatcher::Resume( MethodId methodIndex, void** arguments ) {
+    LuaCBackMethod* m = luaCBackMethods_[ methodIndex ];
+    lua_State* L = lc_->LuaState();
+    // keep the coroutine on the stack: the reference is released together
+    // with the method
+    lua_rawgeti( L, LUA_REGISTRYINDEX, m->CBackRef() );
+    lua_State* co = lua_tothread( L, -1 );
+    // the coroutine must still be suspended in the qlua.wait call of this
+    // waiter: it might have been resumed from Lua in the meantime and have
+    // yielded elsewhere or waited again
+    PushWaitTable( L );
+    lua_pushvalue( L, -2 );
+    lua_rawget( L, -2 );
+    const bool resume = co && lua_status( co ) == LUA_YIELD
+                        && lua_isnumber( L, -1 ) && lua_tointeger( L, -1 ) == methodIndex
+                        && SuspendedInWait( co );
+    lua_pop( L, 2 );
+    const int numArgs = resume ? m->PushArguments( arguments ) : 0;
+    ReleaseWaiter( L, methodIndex );
+    if( resume ) {
+        lua_xmove( L, co, numArgs );
+#if LUA_VERSION_NUM > 501
+        const int status = lua_resume( co, L, numArgs );
+#else
+        const int status = lua_resume( co, numArgs );
+#endif
+        // errors terminate the coroutine: report and remove message
+        if( status != 0 && status != LUA_YIELD ) {
+            if( lc_ ) lc_->ReportCallbackError( L, lua_tostring( co, -1 ) );
+            lua_pop( co, 1 );
+        }
+    }
+    lua_pop( L, 1 ); // coroutine
+}
+//------------------------------------------------------------------------------
+void LuaCallbackDispatcher::ReleaseWaiter( lua_State* L, MethodId methodIndex ) {
+    typedef QList< QPair< QObject*, int > > Sources;
+    const Sources sources = luaCBackMethods_[ methodIndex ]->Sources();
+    for( Sources::const_iterator i = sources.begin(); i != sources.end(); ++i ) {
+        QMetaObject::disconnect( i->first, i->second, this,
+                                 methodIndex + FIRST_CBACK_METHOD + metaObject()->methodCount() );
+    }
+    ReleaseMethod( L, methodIndex );
+}
+//------------------------------------------------------------------------------
+// Invoked from threads other than the one of the dispatcher: method
+// information is read under lock, arguments are copied and the emission is
+// added to the lock-free queue; a single wake-up event is posted for any
+// number of emissions queued before the queue is drained
+void LuaCallbackDispatcher::Enqueue( MethodId methodIndex, void** arguments ) {
+    QueuedEmission* e = new QueuedEmission;
+    {
+        QMutexLocker lock( &methodsMutex_ );
+        if( methodIndex >= luaCBackMethods_.size() || !luaCBackMethods_[ methodIndex ] ) {
+            delete e;
+            return;
+        }
+        const LuaCBackMethod* m = luaCBackMethods_[ methodIndex ];
+        e->methodId_ = methodIndex;
+        e->serial_ = m->Serial();
+        e->types_ = m->ParameterTypes();
+    }
+    e->args_.resize( e->types_.size() + 1 );
+    e->args_[ 0 ] = 0;
+    for( int i = 0; i != e->types_.size(); ++i ) {
+        e->args_[ i + 1 ] = QMetaType::construct( e->types_[ i ].MetaType(), arguments[ i + 1 ] );
+    }
+    emissionQueue_.Push( e );
+    if( wakeUpPosted_.testAndSetOrdered( 0, 1 ) ) {
+        QCoreApplication::postEvent( this, new QEvent( QEvent::User ) );
+    }
+}
+//------------------------------------------------------------------------------
+void LuaCallbackDispatcher::customEvent( QEvent* e ) {
+    if( e->type() != QEvent::User ) {
+        QObject::customEvent( e );
+        return;
+    }
+    // reset flag before draining: emissions queued from now on post a
+    // new event
+    wakeUpPosted_.fetchAndStoreOrdered( 0 );
+    while( QueuedEmission* q = emissionQueue_.Pop() ) {
+        const MethodId id = q->methodId_;
+        if( id < luaCBackMethods_.size() && luaCBackMethods_[ id ]
+            && luaCBackMethods_[ id ]->Serial() == q->serial_ ) {
+            Deliver( id, q->args_.data() );
+        }
+        delete q;
+    }
+}
+//------------------------------------------------------------------------------
+QList< CallbackStats > LuaCallbackDispatcher::Stats() const {
+    QList< CallbackStats > stats;
+    for( QList< LuaCBackMethod* >::const_iterator i = luaCBackMethods_.begin();
+         i != luaCBackMethods_.end(); ++i ) {
+        if( *i && !( *i )->IsWaiter() ) stats.push_back( ( *i )->Stats() );
+    }
+    return stats;
+}
+//------------------------------------------------------------------------------
+void LuaCallbackDispatcher::ResetStats() {
+    for( QList< LuaCBackMethod* >::iterator i = luaCBackMethods_.begin();
+         i != luaCBackMethods_.end(); ++i ) {
+        if( *i ) ( *i )->ResetStats();
+    }
+}
+//------------------------------------------------------------------------------
+void LuaCallbackDispatcher::PushStats( lua_State* L ) const {
+    lua_newtable( L );
+    int n = 0;
+    for( QList< LuaCBackMethod* >::const_iterator i = luaCBackMethods_.begin();
+         i != luaCBackMethods_.end(); ++i ) {
+        if( !*i || ( *i )->IsWaiter() ) continue;
+        const CallbackStats s = ( *i )->Stats();
+        lua_createtable( L, 0, 8 );
+        // the handlers of multicast methods are not exposed
+        if( !( *i )->IsMulticast() ) {
+            ( *i )->PushCallback( L );
+            lua_setfield( L, -2, "callback" );
+        }
+        lua_pushlstring( L, s.signature_.constData(), s.signature_.size() );
+        lua_setfield( L, -2, "signature" );
+        lua_pushlstring( L, s.source_.constData(), s.source_.size() );
+        lua_setfield( L, -2, "source" );
+        lua_createtable( L, s.senders_.size(), 0 );
+        for( int j = 0; j != s.senders_.size(); ++j ) {
+            lua_pushlstring( L, s.senders_[ j ].constData(), s.senders_[ j ].size() );
+            lua_rawseti( L, -2, j + 1 );
+        }
+        lua_setfield( L, -2, "senders" );
+        lua_pushnumber( L, lua_Number( s.invocations_ ) );
+        lua_setfield( L, -2, "invocations" );
+        lua_pushnumber( L, lua_Number( s.errors_ ) );
+        lua_setfield( L, -2, "errors" );
+        lua_pushnumber( L, lua_Number( s.totalTime_ ) / 1E6 );
+        lua_setfield( L, -2, "totalTime" );
+        lua_pushnumber( L, lua_Number( s.maxTime_ ) / 1E6 );
+        lua_setfield( L, -2, "maxTime" );
+        lua_rawseti( L, -2, ++n );
+    }
+}
+//------------------------------------------------------------------------------
+void LuaCallbackDispatcher::timerEvent( QTimerEvent* e ) {
+    QHash< int, MethodId >::const_iterator i = flushTimers_.find( e->timerId() );
+    if( i == flushTimers_.end() ) {
+        QObject::timerEvent( e );
+        return;
+    }
+    FlushMethod( *i );
+}
+//------------------------------------------------------------------------------
+void LuaCallbackDispatcher::FlushMethod( MethodId methodIdx ) {
+    LuaCBackMethod* m = luaCBackMethods_[ methodIdx ];
+    if( m->TimerId() ) {
+        killTimer( m->TimerId() );
+        flushTimers_.remove( m->TimerId() );
+        m->SetTimerId( 0 );
+    }
+    // the method might be released by the Lua function: Flush must be
+    // the last operation
+    m->Flush();
+}
+//------------------------------------------------------------------------------
+LuaCBackMethod::LuaCBackMethod( LuaContext* lc, const CBackParameterTypes& p,
+                                int luaCBackRef, const QByteArray& key,
+                                const DeliveryOptions& options, int weakTableRef )
+    : lc_( lc ), paramTypes_( p ), luaCBackRef_( luaCBackRef ), key_( key ),
+      numConnections_( 0 ), options_( options ), numEmissions_( 0 ),
+      timerId_( 0 ), serial_( 0 ), waiter_( false ), multicast_( false ), activeCalls_( 0 ),
+      released_( false ), weakTableRef_( weakTableRef ) {
+    // location of function definition
+    lua_State* L = lc_->LuaState();
+    PushCallback( L );
+    if( lua_isfunction( L, -1 ) ) {
+        lua_Debug ar;
+        lua_getinfo( L, ">S", &ar ); // pops function
+        stats_.source_ = QByteArray( ar.short_src ) + ':' + QByteArray::number( ar.linedefined );
+    } else lua_pop( L, 1 );
+    stats_.signature_ = key_.left( key_.indexOf( '|' ) );
+    if( options_.mode_ == DeliveryOptions::DELIVER_LATEST ) options_.capacity_ = 1;
+    if( options_.mode_ != DeliveryOptions::DELIVER_IMMEDIATE ) {
+        if( options_.capacity_ < 1 ) options_.capacity_ = 1;
+        emissions_.fill( 0, options_.capacity_ * paramTypes_.size() );
+    }
+}
+//------------------------------------------------------------------------------
+void LuaCBackMethod::PushArgument( const LArgWrapper& type, void* value ) {
+    type.Push( lc_->LuaState(), value );
+    // QObject pointers are replaced with cached wrappers
+    if( type.IsQObjectPtr() ) {
+        QObject* obj = reinterpret_cast< QObject* >( lua_touserdata( lc_->LuaState(), -1 ) );
+        lua_pop( lc_->LuaState(), 1 );
+        lc_->PushQObject( obj );
+    }
+}
+//------------------------------------------------------------------------------
+bool LuaCBackMethod::Queue( void **arguments ) {
+    ++arguments; // first parameter is placeholder for return argument! - ignore
+    const int numParams = paramTypes_.size();
+    // in latest mode the single slot is overwritten
+    if( numEmissions_ == options_.capacity_ ) Clear();
+    void** slot = emissions_.data() + numEmissions_ * numParams;
+    for( int p = 0; p != numParams; ++p ) {
+        slot[ p ] = QMetaType::construct( paramTypes_[ p ].MetaType(), arguments[ p ] );
+    }
+    ++numEmissions_;
+    return options_.mode_ == DeliveryOptions::DELIVER_BATCHED 
+           && numEmissions_ == options_.capacity_;
+}
+//------------------------------------------------------------------------------
+void LuaCBackMethod::Flush() {
+    if( numEmissions_ == 0 ) return;
+    lua_State* L = lc_->LuaState();
+    const int numParams = paramTypes_.size();
+    PushCallback( L );
+    if( lua_isnil( L, -1 ) ) {
+        lua_pop( L, 1 );
+        Clear();
+        return;
+    }
+    int numArgs = numParams;
+    if( options_.mode_ == DeliveryOptions::DELIVER_BATCHED ) {
+        // single array of emissions, each emission is an array of arguments
+        lua_createtable( L, numEmissions_, 0 );
+        for( int e = 0; e != numEmissions_; ++e ) {
+            void** slot = emissions_.data() + e * numParams;
+            lua_createtable( L, numParams, 0 );
+            for( int p = 0; p != numParams; ++p ) {
+                PushArgument( paramTypes_[ p ], slot[ p ] );
+                lua_rawseti( L, -2, p + 1 );
+            }
+            lua_rawseti( L, -2, e + 1 );
+        }
+        numArgs = 1;
+    } else {
+        void** slot = emissions_.data();
+        for( int p = 0; p != numParams; ++p ) PushArgument( paramTypes_[ p ], slot[ p ] );
+    }
+    // values are copied into Lua: clear buffer before calling the function
+    // which might trigger new emissions
+    Clear();
+    Call( numArgs );
+}
+//------------------------------------------------------------------------------
+void LuaCBackMethod::Clear() {
+    const int numParams = paramTypes_.size();
+    for( int e = 0; e != numEmissions_; ++e ) {
+        void** slot = emissions_.data() + e * numParams;
+        for( int p = 0; p != numParams; ++p ) {
+            QMetaType::destroy( paramTypes_[ p ].MetaType(), slot[ p ] );
+            slot[ p ] = 0;
+        }
+    }
+    numEmissions_ = 0;
+}
+//------------------------------------------------------------------------------
 void LuaCBackMethod::Invoke( void **arguments ) {
-    lua_rawgeti( lc_->LuaState(), LUA_REGISTRYINDEX, luaCBackRef_ ); 
+    if( multicast_ ) {
+        InvokeHandlers( arguments );
+        return;
+    }
+    PushCallback( lc_->LuaState() );
+    // function of weak connection collected: the method is released when
+    // the sentinel is collected
+    if( lua_isnil( lc_->LuaState(), -1 ) ) {
+        lua_pop( lc_->LuaState(), 1 );
+        return;
+    }
+    //call Lua function
+    Call( PushArguments( arguments ) );
+}
+//------------------------------------------------------------------------------
+void LuaCBackMethod::PushCallback( lua_State* L ) const {
+    if( weakTableRef_ != LUA_NOREF ) {
+        lua_rawgeti( L, LUA_REGISTRYINDEX, weakTableRef_ );
+        lua_rawgeti( L, -1, luaCBackRef_ );
+        lua_remove( L, -2 );
+    } else lua_rawgeti( L, LUA_REGISTRYINDEX, luaCBackRef_ );
+}
+//------------------------------------------------------------------------------
+bool LuaCBackMethod::HasSender( QObject* obj ) const {
+    typedef QHash< QPair< QObject*, int >, int > Connections;
+    for( Connections::const_iterator i = connections_.begin(); i != connections_.end(); ++i ) {
+        if( i.key().first == obj ) return true;
+    }
+    return false;
+}
+//------------------------------------------------------------------------------
+void LuaCBackMethod::RemoveSender( QObject* obj ) {
+    typedef QHash< QPair< QObject*, int >, int > Connections;
+    for( Connections::iterator i = connections_.begin(); i != connections_.end(); ) {
+        if( i.key().first == obj ) {
+            numConnections_ -= i.value();
+            i = connections_.erase( i );
+        } else ++i;
+    }
+}
+//------------------------------------------------------------------------------
+bool LuaCBackMethod::Call( int numArgs, bool checkResult ) {
+    lua_State* L = lc_->LuaState();
+    // insert message handler below function
+    const int handlerIndex = lua_gettop( L ) - numArgs;
+    lua_pushcfunction( L, Traceback );
+    lua_insert( L, handlerIndex );
+    // the method might be released by the Lua function: deletion is deferred
+    // until the call returns
+    ++activeCalls_;
+    QElapsedTimer timer;
+    timer.start();
+    const int status = lua_pcall( L, numArgs, checkResult ? 1 : 0, handlerIndex );
+    const qint64 elapsed = Nanoseconds( timer );
+    --activeCalls_;
+    ++stats_.invocations_;
+    stats_.totalTime_ += elapsed;
+    stats_.maxTime_ = qMax( stats_.maxTime_, elapsed );
+    if( status != 0 ) {
+        ++stats_.errors_;
+        lc_->ReportCallbackError( L, lua_tostring( L, -1 ) );
+        lua_pop( L, 1 );
+    }
+    bool result = false;
+    if( status == 0 && checkResult ) {
+        result = lua_isboolean( L, -1 ) && lua_toboolean( L, -1 );
+        lua_pop( L, 1 );
+    }
+    lua_pop( L, 1 ); // message handler
+    if( released_ && activeCalls_ == 0 ) delete this;
+    return result;
+}
+//------------------------------------------------------------------------------
+void LuaCBackMethod::InvokeHandlers( void **arguments ) {
+    lua_State* L = lc_->LuaState();
+    PushCallback( L );
+    const int handlers = lua_gettop( L );
+    const int numHandlers = LuaArrayLength( L, handlers );
+    // arguments are converted once and copied for each handler
+    const int numArgs = PushArguments( arguments );
+    // handlers might release the method: deletion is deferred until all the
+    // handlers have been invoked
+    ++activeCalls_;
+    for( int h = 1; h <= numHandlers; ++h ) {
+        lua_rawgeti( L, handlers, h );
+        for( int a = 1; a <= numArgs; ++a ) lua_pushvalue( L, handlers + a );
+        // returning true stops propagation
+        if( Call( numArgs, true ) ) break;
+    }
+    --activeCalls_;
+    lua_settop( L, handlers - 1 );
+    if( released_ && activeCalls_ == 0 ) delete this;
+}
+//------------------------------------------------------------------------------
+void LuaCBackMethod::AddHandler( lua_State* L, int cbackStackIndex, int priority ) {
+    if( cbackStackIndex < 0 ) cbackStackIndex = lua_gettop( L ) + cbackStackIndex + 1;
+    // handlers with the same priority are invoked in connection order
+    int pos = 0;
+    while( pos != priorities_.size() && priorities_[ pos ] >= priority ) ++pos;
+    // copy handlers into new array: the current array might be in use
+    PushCallback( L );
+    const int size = priorities_.size();
+    lua_createtable( L, size + 1, 0 );
+    for( int h = 0; h != size; ++h ) {
+        lua_rawgeti( L, -2, h + 1 );
+        lua_rawseti( L, -2, h < pos ? h + 1 : h + 2 );
+    }
+    lua_pushvalue( L, cbackStackIndex );
+    lua_rawseti( L, -2, pos + 1 );
+    lua_rawseti( L, LUA_REGISTRYINDEX, luaCBackRef_ );
+    lua_pop( L, 1 );
+    priorities_.insert( pos, priority );
+}
+//------------------------------------------------------------------------------
+int LuaCBackMethod::RemoveHandler( lua_State* L, int cbackStackIndex ) {
+    if( cbackStackIndex < 0 ) cbackStackIndex = lua_gettop( L ) + cbackStackIndex + 1;
+    PushCallback( L );
+    lua_createtable( L, priorities_.size(), 0 );
+    QVector< int > priorities;
+    for( int h = 0; h != priorities_.size(); ++h ) {
+        lua_rawgeti( L, -2, h + 1 );
+        if( lua_rawequal( L, -1, cbackStackIndex ) ) lua_pop( L, 1 );
+        else {
+            priorities.push_back( priorities_[ h ] );
+            lua_rawseti( L, -2, priorities.size() );
+        }
+    }
+    const int removed = priorities_.size() - priorities.size();
+    if( removed > 0 ) lua_rawseti( L, LUA_REGISTRYINDEX, luaCBackRef_ );
+    else lua_pop( L, 1 );
+    lua_pop( L, 1 );
+    priorities_ = priorities;
+    return removed;
+}
+//------------------------------------------------------------------------------
+void LuaCBackMethod::Release() {
+    if( activeCalls_ > 0 ) released_ = true;
+    else delete this;
+}
+//------------------------------------------------------------------------------
+CallbackStats LuaCBackMethod::Stats() const {
+    CallbackStats stats = stats_;
+    // senders are read when requested: object names might change after the
+    // connection is established
+    for( QHash< QPair< QObject*, int >, int >::const_iterator i = connections_.begin();
+         i != connections_.end(); ++i ) {
+        const QObject* obj = i.key().first;
+        stats.senders_.push_back( obj->objectName().toUtf8() + ':'
+                                  + obj->metaObject()->method( i.key().second ).signature() );
+    }
+    qSort( stats.senders_ );
+    return stats;
+}
+//------------------------------------------------------------------------------
+void LuaCBackMethod::ResetStats() {
+    stats_.invocations_ = 0;
+    stats_.errors_ = 0;
+    stats_.totalTime_ = 0;
+    stats_.maxTime_ = 0;
+}
+//------------------------------------------------------------------------------
+int LuaCBackMethod::PushArguments( void **arguments ) {
     ++arguments; // first parameter is placeholder for return argument! - ignore
     //iterate over arguments and push values on Lua stack
     for( CBackParameterTypes::const_iterator i = paramTypes_.begin();
          i != paramTypes_.end(); ++i, ++arguments ) {
-        i->Push( lc_->LuaState(), *arguments );
-        if( i->IsQObjectPtr() ) {
-            QObject* obj = reinterpret_cast< QObject* >( lua_touserdata( lc_->LuaState(), -1 ) );
-            lua_pop( lc_->LuaState(), 1 );
-            lc_->AddQObject( obj );
-        }
+        PushArgument( *i, *arguments );
     }
-    //call Lua function
-    lua_pcall( lc_->LuaState(), paramTypes_.size(), 0, 0 );
+    return paramTypes_.size();
 }
 
+//------------------------------------------------------------------------------
+// Return meta type ids of parameters of method
+static QList< int > ParameterTypeIds( const QMetaMethod& mm ) {
+    QList< int > types;
+    const QList< QByteArray > params = mm.parameterTypes();
+    for( QList< QByteArray >::const_iterator i = params.begin(); i != params.end(); ++i ) {
+        types.push_back( QMetaType::type( i->constData() ) );
+    }
+    return types;
+}
+//------------------------------------------------------------------------------
+ArgumentAdapter::ArgumentAdapter( QObject* sender, int signalIdx, QObject* target,
+                                  int methodIdx, const Sources& sources )
+    : QObject( target ), sender_( sender ), signalIdx_( signalIdx ),
+      methodIdx_( methodIdx ), sources_( sources ) {
+    signalTypes_ = ParameterTypeIds( sender->metaObject()->method( signalIdx ) );
+    targetTypes_ = ParameterTypeIds( target->metaObject()->method( methodIdx ) );
+    // constants are converted once; a failed conversion still changes the
+    // type of the constant and is reported by Validate
+    for( int i = 0; i != sources_.size() && i != targetTypes_.size(); ++i ) {
+        Source& s = sources_[ i ];
+        if( s.signalArg_ < 0 && targetTypes_[ i ] != QMetaType::QVariant ) {
+            s.converted_ = s.constant_.convert( QVariant::Type( targetTypes_[ i ] ) );
+        }
+    }
+}
+//------------------------------------------------------------------------------
+bool ArgumentAdapter::Validate( QString& error ) const {
+    if( sources_.size() != targetTypes_.size() ) {
+        error = "Wrong number of arguments: " + QString::number( targetTypes_.size() ) 
+                + " required";
+        return false;
+    }
+    for( int i = 0; i != targetTypes_.size(); ++i ) {
+        const int t = targetTypes_[ i ];
+        const Source& s = sources_[ i ];
+        if( t == QMetaType::Void ) {
+            error = "Unknown type of argument " + QString::number( i + 1 );
+            return false;
+        }
+        if( s.signalArg_ < 0 ) {
+            if( !s.converted_ || ( t != QMetaType::QVariant && s.constant_.userType() != t ) ) {
+                error = "Cannot convert constant to type of argument " + QString::number( i + 1 );
+                return false;
+            }
+            continue;
+        }
+        if( s.signalArg_ >= signalTypes_.size() ) {
+            error = "Signal argument " + QString::number( s.signalArg_ + 1 ) + " out of range";
+            return false;
+        }
+        const int st = signalTypes_[ s.signalArg_ ];
+        if( st == t || t == QMetaType::QVariant ) continue;
+        if( st == QMetaType::Void || !QVariant( st, ( const void* ) 0 ).canConvert( QVariant::Type( t ) ) ) {
+            error = "Cannot convert signal argument " + QString::number( s.signalArg_ + 1 )
+                    + " to type of argument " + QString::number( i + 1 );
+            return false;
+        }
+    }
+    return true;
+}
+//------------------------------------------------------------------------------
+bool ArgumentAdapter::Connect() {
+    if( !QMetaObject::connect( sender_, signalIdx_, this, metaObject()->methodCount() + FORWARD_METHOD ) ) {
+        return false;
+    }
+    // adapter is deleted together with sender as well
+    QMetaObject::connect( sender_, DestroyedSignalIndex(), this,
+                          metaObject()->methodCount() + SENDER_DESTROYED_METHOD );
+    return true;
+}
+//------------------------------------------------------------------------------
+int ArgumentAdapter::qt_metacall( QMetaObject::Call invoke, int id, void **arguments ) {
+    id = QObject::qt_metacall( invoke, id, arguments );
+    if( id < 0 || invoke != QMetaObject::InvokeMetaMethod ) return id;
+    if( id == SENDER_DESTROYED_METHOD ) {
+        deleteLater();
+        return -1;
+    }
+    const int numArgs = targetTypes_.size();
+    // converted values are stored in per-call variants
+    QVarLengthArray< QVariant, 10 > converted( numArgs );
+    QVarLengthArray< void*, 11 > argv( numArgs + 1 );
+    argv[ 0 ] = 0; // return value not required
+    for( int i = 0; i != numArgs; ++i ) {
+        Source& s = sources_[ i ];
+        const int t = targetTypes_[ i ];
+        if( s.signalArg_ < 0 ) {
+            argv[ i + 1 ] = t == QMetaType::QVariant ? &s.constant_ : s.constant_.data();
+            continue;
+        }
+        const int st = signalTypes_[ s.signalArg_ ];
+        void* value = arguments[ s.signalArg_ + 1 ];
+        if( st == t ) {
+            argv[ i + 1 ] = value;
+        } else {
+            converted[ i ] = QVariant( st, value );
+            if( t == QMetaType::QVariant ) argv[ i + 1 ] = &converted[ i ];
+            else {
+                // the method is not invoked with values which cannot be
+                // converted, e.g. non-numeric strings passed as numbers
+                if( !converted[ i ].convert( QVariant::Type( t ) ) ) {
+                    qWarning( "qlua: emission of %s skipped: argument %d cannot be converted to %s",
+                              sender_->metaObject()->method( signalIdx_ ).signature(),
+                              s.signalArg_ + 1, QMetaType::typeName( t ) );
+                    return -1;
+                }
+                argv[ i + 1 ] = converted[ i ].data();
+            }
+        }
+    }
+    if( QMetaObject::metacall( parent(), QMetaObject::InvokeMetaMethod, methodIdx_, argv.data() ) >= 0 ) {
+        qWarning( "qlua: method %s not invoked",
+                  parent()->metaObject()->method( methodIdx_ ).signature() );
+    }
+    return -1;
+}
+//------------------------------------------------------------------------------
+bool ArgumentAdapter::Disconnect( QObject* sender, int signalIdx, QObject* target, int methodIdx ) {
+    bool found = false;
+    const QObjectList children = target->children();
+    for( QObjectList::const_iterator i = children.begin(); i != children.end(); ++i ) {
+        ArgumentAdapter* a = dynamic_cast< ArgumentAdapter* >( *i );
+        if( a && a->Matches( sender, signalIdx, methodIdx ) ) {
+            delete a;
+            found = true;
+        }
+    }
+    return found;
+}
 }
 
 // Pre-defined types in Qt meta-type environment:
@@ -29,6 +29,15 @@
 
 #include <QMap>
 #include <QList>
+#include <QHash>
+#include <QPair>
+#include <QSet>
+#include <QVector>
+#include <QByteArray>
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QMutex>
+#include <QVariant>
 
 #include "LuaArguments.h"
 
@@ -39,6 +48,73 @@ class LuaContext;
 
 typedef QList< LArgWrapper > CBackParameterTypes;
 
+//------------------------------------------------------------------------------
+/// @brief Statistics of a Lua function connected to signals.
+///
+/// Times are measured around each call of the Lua function and expressed
+/// in nanoseconds.
+struct CallbackStats {
+    /// Signal parameter signature, shared by all the connected signals
+    QByteArray signature_;
+    /// Location where the Lua function is defined, as "source:line"
+    QByteArray source_;
+    /// Connected signals, one element per (sender, signal) pair, as
+    /// "sender object name:signal signature"
+    QList< QByteArray > senders_;
+    /// Number of calls
+    quint64 invocations_;
+    /// Number of calls which raised an error
+    quint64 errors_;
+    /// Cumulative time
+    qint64 totalTime_;
+    /// Maximum time of a single call
+    qint64 maxTime_;
+    CallbackStats() : invocations_( 0 ), errors_( 0 ), totalTime_( 0 ), maxTime_( 0 ) {}
+};
+
+//------------------------------------------------------------------------------
+/// @brief Policy used to deliver signals to Lua functions.
+///
+/// - @c DELIVER_IMMEDIATE: the Lua function is called each time the signal
+///   is emitted
+/// - @c DELIVER_BATCHED: emissions are stored into a fixed size buffer and the
+///   Lua function is called once per flush with an array of emissions, each
+///   emission being an array of signal arguments; the buffer is flushed
+///   when the timer expires or when full
+/// - @c DELIVER_LATEST: only the arguments of the last emission are kept and
+///   passed to the Lua function when the timer expires
+///
+/// The timer is started when the first emission is queued: an interval of zero
+/// flushes the queued emissions as soon as the event loop is idle.
+/// Options also specify if the connection is weak.
+struct DeliveryOptions {
+    enum Mode { DELIVER_IMMEDIATE, DELIVER_BATCHED, DELIVER_LATEST };
+    /// Delivery policy
+    Mode mode_;
+    /// Flush interval in milliseconds
+    int interval_;
+    /// Number of emissions stored in batched mode before the buffer is flushed
+    int capacity_;
+    /// @brief Weak connection: the Lua function is not referenced by the
+    /// connection and the connection is removed when the function is garbage
+    /// collected.
+    bool weak_;
+    DeliveryOptions( Mode mode = DELIVER_IMMEDIATE, int interval = 0, int capacity = 1024,
+                     bool weak = false )
+        : mode_( mode ), interval_( interval ), capacity_( capacity ), weak_( weak ) {}
+    /// Return key identifying options, empty for immediate strong delivery
+    QByteArray Key() const {
+        QByteArray k;
+        if( mode_ != DELIVER_IMMEDIATE ) {
+            k = mode_ == DELIVER_BATCHED ? "|batched:" : "|latest:";
+            k += QByteArray::number( interval_ );
+            if( mode_ == DELIVER_BATCHED ) k += ':' + QByteArray::number( capacity_ );
+        }
+        if( weak_ ) k += "|weak";
+        return k;
+    }
+};
+
 //------------------------------------------------------------------------------
 /// @brief C++ method abstraction: Qt signals are connected to instances of this
 /// class which invokes associated Lua function through the @c Invoke method.
@@ -55,8 +131,17 @@ public:
     ///          into Lua values
     /// @param luaCBackRef reference (as a Lua integer reference) to Lua function
     ///                    to invoke
-    LuaCBackMethod( LuaContext* lc, const CBackParameterTypes& p, int luaCBackRef ) 
-        : lc_( lc ), paramTypes_( p ), luaCBackRef_( luaCBackRef ) {}
+    /// @param key signal parameter signature e.g. "(int,QString)" followed by
+    ///            delivery options key
+    /// @param options delivery options
+    /// @param weakTableRef reference to weak-valued table: if not @c LUA_NOREF
+    ///        @c luaCBackRef is a reference into this table instead of the registry
+    LuaCBackMethod( LuaContext* lc, const CBackParameterTypes& p, int luaCBackRef,
+                    const QByteArray& key,
+                    const DeliveryOptions& options = DeliveryOptions(),
+                    int weakTableRef = LUA_NOREF );
+    /// Destructor: destroy queued values
+    ~LuaCBackMethod() { Clear(); }
     /// @brief Called by QObject::qt_metacall as part of a signal-method invocation. 
     ///
     /// Iterates over the list of arguments and parameter types in parallel and
@@ -67,8 +152,109 @@ public:
     /// When a QObject is added to the Lua context its life-time is not
     /// managed by Lua.
     void Invoke( void **arguments );
+    /// @brief Push signal arguments on the Lua stack.
+    /// @param arguments argument array received from @c qt_metacall
+    /// @return number of pushed values
+    int PushArguments( void **arguments );
+    /// @brief Copy arguments into the emission buffer.
+    ///
+    /// In batched mode arguments are appended to the buffer, in latest mode
+    /// they replace the previously queued ones.
+    /// @return @c true if buffer is full and must be flushed
+    bool Queue( void **arguments );
+    /// Call Lua function with queued emissions and clear buffer.
+    void Flush();
+    /// Return delivery options
+    const DeliveryOptions& Options() const { return options_; }
+    /// Return id of timer used to flush queued emissions, zero if not running
+    int TimerId() const { return timerId_; }
+    /// Set id of flush timer
+    void SetTimerId( int id ) { timerId_ = id; }
+    /// Return serial number, unique among all the methods created by a dispatcher
+    unsigned Serial() const { return serial_; }
+    /// Set serial number
+    void SetSerial( unsigned s ) { serial_ = s; }
+    /// Return parameter types
+    const CBackParameterTypes& ParameterTypes() const { return paramTypes_; }
+    /// @brief Set waiter flag: waiters reference a suspended coroutine instead
+    /// of a function and are released after the first emission.
+    void SetWaiter( bool w ) { waiter_ = w; }
+    /// Return @c true if method resumes a coroutine
+    bool IsWaiter() const { return waiter_; }
+    /// @brief Set multicast flag: multicast methods reference an array of
+    /// handlers ordered by priority instead of a function.
+    ///
+    /// Signal arguments are converted once per emission and passed to each
+    /// handler; a handler returning @c true stops the propagation of the signal
+    /// to the following handlers.
+    void SetMulticast( bool m ) { multicast_ = m; }
+    /// Return @c true if method invokes an ordered list of handlers
+    bool IsMulticast() const { return multicast_; }
+    /// @brief Add handler to multicast method.
+    ///
+    /// Handlers with higher priority are invoked first, handlers with the same
+    /// priority are invoked in connection order.
+    /// @param L Lua state
+    /// @param cbackStackIndex position of Lua function in Lua stack
+    /// @param priority handler priority
+    void AddHandler( lua_State* L, int cbackStackIndex, int priority );
+    /// @brief Remove all occurrences of handler from multicast method.
+    /// @return number of removed handlers
+    int RemoveHandler( lua_State* L, int cbackStackIndex );
+    /// Return number of handlers of multicast method
+    int Handlers() const { return priorities_.size(); }
+    /// Return call statistics, including the currently connected signals
+    CallbackStats Stats() const;
+    /// Reset call statistics
+    void ResetStats();
+    /// Delete method, or mark it for deletion if the Lua function is being called
+    void Release();
+    /// Return (source QObject, signal index) pairs connected to this method
+    QList< QPair< QObject*, int > > Sources() const { return connections_.keys(); }
     /// Return associated reference to Lua function
     int CBackRef() const{ return luaCBackRef_; } 
+    /// Return reference to table holding the Lua function reference,
+    /// @c LUA_NOREF if reference is stored in the registry
+    int WeakTableRef() const { return weakTableRef_; }
+    /// Push Lua function on the Lua stack; nil is pushed if the function of a
+    /// weak connection was garbage collected
+    void PushCallback( lua_State* L ) const;
+    /// Return key: signal parameter signature followed by delivery options key
+    const QByteArray& Key() const { return key_; }
+    /// Record connection from signal
+    void AddConnection( QObject* obj, int signalIdx ) {
+        ++connections_[ qMakePair( obj, signalIdx ) ];
+        ++numConnections_;
+    }
+    /// Remove all connections from signal
+    void RemoveConnections( QObject* obj, int signalIdx ) {
+        numConnections_ -= connections_.take( qMakePair( obj, signalIdx ) );
+    }
+    /// Remove all connections from signals of QObject
+    void RemoveSender( QObject* obj );
+    /// Return @c true if any signal of QObject is connected to this method
+    bool HasSender( QObject* obj ) const;
+    /// Return number of signals connected to this method
+    int Connections() const { return numConnections_; }
+private:
+    /// Push signal argument on the Lua stack, QObject pointers are pushed
+    /// as wrappers
+    void PushArgument( const LArgWrapper& type, void* value );
+    /// Destroy all queued values
+    void Clear();
+    /// @brief Call Lua function with arguments on top of the Lua stack.
+    ///
+    /// The function is called in protected mode with a message handler which
+    /// adds a traceback to error messages; errors are reported through
+    /// LuaContext and removed from the stack. Call statistics are updated.
+    /// @param numArgs number of arguments
+    /// @param checkResult if @c true the first returned value is checked
+    /// @return @c true if @c checkResult is set and the function returned @c true
+    bool Call( int numArgs, bool checkResult = false );
+    /// @brief Invoke handlers of multicast method: the array of handlers is
+    /// replaced when handlers are added or removed, so the array on the stack
+    /// is not affected by connections performed by the handlers.
+    void InvokeHandlers( void **arguments );
 private:
     /// LuaContext instance
     LuaContext* lc_;
@@ -76,67 +262,407 @@ private:
     CBackParameterTypes paramTypes_;
     /// Reference to Lua function to invoke
     int luaCBackRef_;
+    /// Signal parameter signature and delivery options key
+    QByteArray key_;
+    /// Number of connections for each (source QObject, signal index) pair
+    QHash< QPair< QObject*, int >, int > connections_;
+    /// Total number of connections
+    int numConnections_;
+    /// Delivery options
+    DeliveryOptions options_;
+    /// @brief Preallocated buffer of queued emissions: each emission is a
+    /// sequence of pointers to copies of the signal arguments.
+    QVector< void* > emissions_;
+    /// Number of queued emissions
+    int numEmissions_;
+    /// Flush timer id
+    int timerId_;
+    /// Serial number
+    unsigned serial_;
+    /// Waiter flag
+    bool waiter_;
+    /// Multicast flag
+    bool multicast_;
+    /// Priorities of handlers of multicast method, in invocation order
+    QVector< int > priorities_;
+    /// Call statistics
+    CallbackStats stats_;
+    /// Number of calls in progress: callbacks can be nested
+    int activeCalls_;
+    /// Set if method was released while the Lua function was being called
+    bool released_;
+    /// Reference to weak-valued table holding function reference
+    int weakTableRef_;
 };
 
 
 typedef int LuaCBackRef;
 typedef int MethodId;
 
+//------------------------------------------------------------------------------
+/// @brief Signal emission received from a thread other than the one of the
+/// dispatcher: arguments are copies created through QMetaType::construct.
+struct QueuedEmission {
+    /// Next element in queue
+    QAtomicPointer< QueuedEmission > next_;
+    /// Target method id
+    MethodId methodId_;
+    /// Target method serial number: queued emissions targeting a released
+    /// method whose id was recycled are discarded
+    unsigned serial_;
+    /// Argument types, used to destroy arguments
+    CBackParameterTypes types_;
+    /// Arguments; first element is placeholder for return value
+    QVector< void* > args_;
+    QueuedEmission() : next_( 0 ), methodId_( -1 ), serial_( 0 ) {}
+    /// Destroy copied arguments
+    ~QueuedEmission() {
+        for( int i = 0; i != types_.size(); ++i ) {
+            QMetaType::destroy( types_[ i ].MetaType(), args_[ i + 1 ] );
+        }
+    }
+};
+
+//------------------------------------------------------------------------------
+/// @brief Lock-free multiple producer, single consumer intrusive queue
+/// (Vyukov's algorithm).
+///
+/// Any thread can Push elements, elements are popped only from the thread
+/// of the dispatcher. The queue owns the elements it contains.
+class EmissionQueue {
+public:
+    EmissionQueue() : head_( &stub_ ), tail_( &stub_ ) {}
+    /// Delete all queued elements
+    ~EmissionQueue() {
+        while( QueuedEmission* e = Pop() ) delete e;
+    }
+    /// Add element: wait-free, callable from any thread
+    void Push( QueuedEmission* e ) {
+        e->next_ = 0;
+        QueuedEmission* prev = head_.fetchAndStoreOrdered( e );
+        prev->next_.fetchAndStoreRelease( e );
+    }
+    /// Remove element: callable from consumer thread only; returns null if
+    /// queue is empty or an element is being added
+    QueuedEmission* Pop() {
+        QueuedEmission* tail = tail_;
+        QueuedEmission* next = tail->next_;
+        if( tail == &stub_ ) {
+            if( next == 0 ) return 0;
+            tail_ = next;
+            tail = next;
+            next = next->next_;
+        }
+        if( next ) {
+            tail_ = next;
+            return tail;
+        }
+        if( tail != head_ ) return 0;
+        Push( &stub_ );
+        next = tail->next_;
+        if( next ) {
+            tail_ = next;
+            return tail;
+        }
+        return 0;
+    }
+private:
+    /// Last element, updated by producers
+    QAtomicPointer< QueuedEmission > head_;
+    /// First element, updated by consumer
+    QueuedEmission* tail_;
+    /// Stub element
+    QueuedEmission stub_;
+};
+
 //------------------------------------------------------------------------------
 /// @brief Manages Lua function invocation through Qt signals. And connection
 /// of Qt signals to Lua functions or QObject methods.
 ///
 /// Offers methods to connect Qt signals emitted from QObjects to Lua functions
 /// or other QObject methods.
-/// Whenever a new signal -> Lua connection is requested a new proxy method is
-/// generated and the signal is routed to the new method which in turn takes
-/// care of invoking the Lua function.
-/// Note that when disconnecting a signal the associated method is not currently
-/// removed from the method array because signals are connected to methods through
-/// the method's position in the method array, thus removing a method from the array
-/// invalidates all the signal to method connections for which the method index
-/// is greater than the one of the removed method.
+/// Whenever a signal -> Lua function connection is requested the signal is
+/// routed to a proxy method which in turn takes care of invoking the Lua
+/// function. One proxy method is created for each (function, signal signature)
+/// pair and shared by all the connections.
+/// Methods are found from Lua functions through a weak-keyed table stored in
+/// the Lua registry, which maps each function to a table of method ids indexed
+/// by signal signature and delivery options: connect and disconnect operations
+/// do not depend on
+/// the number of existing connections. When the last signal connected to a
+/// method is disconnected the method is deleted and its id is recycled;
+/// signals are connected to methods through the method's position in the
+/// method array, which therefore never shrinks.
 class LuaCallbackDispatcher : public QObject {
 public:
     /// Standard QObject constructor
-    LuaCallbackDispatcher( QObject* parent = 0 ) : QObject( parent ), lc_( 0 ) {}
+    LuaCallbackDispatcher( QObject* parent = 0 ) : QObject( parent ), lc_( 0 ),
+                                                   functionTableRef_( LUA_NOREF ),
+                                                   weakTableRef_( LUA_NOREF ),
+                                                   waitTableRef_( LUA_NOREF ),
+                                                   nextSerial_( 0 ), wakeUpPosted_( 0 ) {}
     /// Constructor, bind dispatcher to Lua context
-    LuaCallbackDispatcher( LuaContext* lc ) : lc_( lc ) {}
-    /// Overridden method: This is what makes it possible to bind a signal
+    LuaCallbackDispatcher( LuaContext* lc ) : lc_( lc ), functionTableRef_( LUA_NOREF ),
+                                              weakTableRef_( LUA_NOREF ),
+                                              waitTableRef_( LUA_NOREF ),
+                                              nextSerial_( 0 ), wakeUpPosted_( 0 ) {}
+    /// @brief Overridden method: This is what makes it possible to bind a signal
     /// to a Lua function through the index of a proxy method.
+    ///
+    /// Signals are connected to proxy methods through direct connections:
+    /// emissions from the thread of the dispatcher invoke the Lua function
+    /// immediately, emissions from other threads are copied into a lock-free
+    /// queue which is drained in the thread of the dispatcher, the only thread
+    /// accessing the Lua state.
     int qt_metacall( QMetaObject::Call c, int id, void **arguments ); 
     /// Connect signal to Lua function
+    /// @param L Lua state
     /// @param obj source QObject
     /// @param signalIdx signal index
     /// @param paramTypes signal signature
-    /// @param luaCBackRef reference to Lua target function created through @c luaL_ref
-    bool Connect( QObject *obj, 
+    /// @param cbackStackIndex position of Lua function in Lua stack
+    /// @param options delivery options
+    bool Connect( lua_State* L,
+                  QObject *obj, 
                   int signalIdx,
                   const CBackParameterTypes& paramTypes,
-                  int luaCBackRef );
-    /// Disconnect signal from Lua function; function must be already on the stack
+                  int cbackStackIndex,
+                  const DeliveryOptions& options = DeliveryOptions() );
+    /// @brief Connect signal to the coroutine running in the passed Lua state.
+    ///
+    /// The coroutine is resumed with the signal arguments at the first
+    /// emission of the signal, after which the connection is removed.
+    /// Only the last waiter of a coroutine resumes it, and only if the
+    /// coroutine is still suspended in @c qlua.wait: a previous waiter of the
+    /// same coroutine, left when yielding failed, is released.
+    /// The waiter id is stored in a table indexed by the coroutine.
+    /// @param L Lua state of a coroutine which yields after this call returns
+    /// @param obj source QObject
+    /// @param signalIdx signal index
+    /// @param paramTypes signal signature
+    /// @return @c false if signal could not be connected
+    bool Wait( lua_State* L,
+               QObject* obj,
+               int signalIdx,
+               const CBackParameterTypes& paramTypes );
+    /// Release the waiter of the coroutine running in the passed Lua state,
+    /// if any: invoked when @c qlua.wait returns
+    void WaitReturned( lua_State* L );
+    /// @brief Add Lua function to the handlers of a signal: the signal is
+    /// connected to a single multicast method per (QObject, signal) pair which
+    /// converts the arguments once per emission.
+    /// @param L Lua state
     /// @param obj source QObject
     /// @param signalIdx signal index
+    /// @param paramTypes signal signature
     /// @param cbackStackIndex position of Lua function in Lua stack
-    bool Disconnect( QObject *obj, 
+    /// @param priority handler priority, handlers with higher priority are
+    ///        invoked first
+    bool ConnectHandler( lua_State* L,
+                         QObject* obj,
+                         int signalIdx,
+                         const CBackParameterTypes& paramTypes,
+                         int cbackStackIndex,
+                         int priority );
+    /// Disconnect signal from Lua function regardless of delivery options and
+    /// remove function from the handlers of the signal;
+    /// function must be already on the stack
+    /// @param L Lua state
+    /// @param obj source QObject
+    /// @param signalIdx signal index
+    /// @param cbackStackIndex position of Lua function in Lua stack
+    bool Disconnect( lua_State* L,
+                     QObject *obj, 
                      int signalIdx,
                      int cbackStackIndex );
+    /// @brief Connect @c destroyed signal of QObject to reserved method which
+    /// removes the object from the LuaContext wrapper cache and releases the
+    /// methods connected only to signals of the object.
+    ///
+    /// Objects are connected only once.
+    void WatchObject( QObject* obj );
     /// Set LuaContext
     void SetLuaContext( LuaContext* lc ) { lc_ = lc; };
-    /// Destructor: Clear method database
+    /// Return statistics of all the connected Lua functions, one element
+    /// per (function, signal signature, delivery options) tuple
+    QList< CallbackStats > Stats() const;
+    /// Reset statistics of all the connected Lua functions
+    void ResetStats();
+    /// @brief Push array of tables with statistics of all the connected Lua
+    /// functions on the Lua stack.
+    ///
+    /// Each table has fields: @c callback (the Lua function), @c signature,
+    /// @c source, @c senders (array of "object name:signal signature" strings),
+    /// @c invocations, @c errors, @c totalTime and @c maxTime;
+    /// times are in milliseconds.
+    void PushStats( lua_State* L ) const;
+    /// Destructor: Clear method database and disable sentinels of weak
+    /// connections, which might be garbage collected after the dispatcher
+    /// is destroyed if the Lua state is not owned by the LuaContext
     virtual ~LuaCallbackDispatcher() {
         for( QList< LuaCBackMethod* >::iterator i = luaCBackMethods_.begin();
              i != luaCBackMethods_.end(); ++i ) {
             delete *i;
         }
+        for( QSet< WeakSentinel* >::iterator i = sentinels_.begin();
+             i != sentinels_.end(); ++i ) {
+            ( *i )->dispatcher_ = 0;
+        }
     }
+protected:
+    /// Flush emissions queued by the method associated with the timer
+    void timerEvent( QTimerEvent* e );
+    /// Deliver emissions received from other threads
+    void customEvent( QEvent* e );
+private:
+    /// @brief Userdata stored in the function table next to the id of a weak
+    /// connection method: collected together with the Lua function.
+    struct WeakSentinel {
+        LuaCallbackDispatcher* dispatcher_;
+        MethodId methodId_;
+        unsigned serial_;
+    };
+    /// @c __gc method of sentinels: release method of weak connection
+    static int WeakSentinelCollected( lua_State* L );
+    /// Push weak-valued table holding references to functions of weak
+    /// connections on the Lua stack, create table if not available
+    void PushWeakTable( lua_State* L );
+    /// Disconnect and release method if it still exists
+    void ReleaseCollected( lua_State* L, MethodId methodIdx, unsigned serial );
+    /// Release methods which have no connections left after sender is destroyed
+    void ReleaseSenderMethods( QObject* obj );
+    /// Reserved method ids: proxy methods start at @c FIRST_CBACK_METHOD
+    enum { OBJECT_DESTROYED_METHOD = 0, FIRST_CBACK_METHOD = 1 };
+    /// Push table mapping Lua functions to method ids on the Lua stack;
+    /// the table is created the first time this method is invoked
+    void PushFunctionTable( lua_State* L );
+    /// Delete method, release reference to Lua function and recycle method id
+    void ReleaseMethod( lua_State* L, MethodId methodIdx );
+    /// Stop flush timer and call Lua function with queued emissions
+    void FlushMethod( MethodId methodIdx );
+    /// Add method to method array reusing unused method ids
+    MethodId AddMethod( LuaCBackMethod* m );
+    /// Deliver signal to method according to delivery options
+    void Deliver( MethodId methodIdx, void** arguments );
+    /// Disconnect and release waiter, resume coroutine with signal arguments
+    void Resume( MethodId methodIdx, void** arguments );
+    /// Disconnect waiter from its signal and release it
+    void ReleaseWaiter( lua_State* L, MethodId methodIdx );
+    /// Push table mapping coroutines to the id of their last waiter on the
+    /// Lua stack, create table if not available
+    void PushWaitTable( lua_State* L );
+    /// Return @c true if the suspended coroutine yielded from @c qlua.wait
+    bool SuspendedInWait( lua_State* co ) const;
+    /// Copy arguments and add emission to cross-thread queue
+    void Enqueue( MethodId methodIdx, void** arguments );
 private:
     /// LuaContext
     LuaContext* lc_;
-    /// Methods
+    /// Methods; NULL elements are unused method ids
     QList< LuaCBackMethod* > luaCBackMethods_;
-    /// Map Lua reference to method index in luaCBackMethods_ list
-    QMap< LuaCBackRef, MethodId > cbackToMethodIndex_;
-   
+    /// @brief Unused method ids, indexed by the parameter types of the
+    /// released methods.
+    ///
+    /// Emissions from other threads can reach a method id after the method
+    /// has been released, since Qt invokes the method without holding the
+    /// connection lock: ids are only reused by methods with the same
+    /// parameter types, so that such emissions copy the signal arguments
+    /// with the right types; they are then discarded by the serial check.
+    QHash< QByteArray, QList< MethodId > > freeMethodIds_;
+    /// Reference to Lua table mapping functions to method ids
+    int functionTableRef_;
+    /// Reference to weak-valued table holding functions of weak connections
+    int weakTableRef_;
+    /// Reference to table mapping coroutines to the id of their last waiter
+    int waitTableRef_;
+    /// Sentinels of weak connections which have not been collected yet
+    QSet< WeakSentinel* > sentinels_;
+    /// Ids of methods connected to signals of each QObject
+    QHash< QObject*, QSet< MethodId > > senderMethods_;
+    /// Multicast method of each (QObject, signal index) pair
+    QHash< QPair< QObject*, int >, MethodId > multicastMethods_;
+    /// (QObject, signal index) pair of each multicast method
+    QHash< MethodId, QPair< QObject*, int > > multicastSources_;
+    /// Objects whose @c destroyed signal is connected to the dispatcher
+    QSet< QObject* > watchedObjects_;
+    /// Map flush timer id to method id
+    QHash< int, MethodId > flushTimers_;
+    /// Serial number of next created method
+    unsigned nextSerial_;
+    /// Protects method list: written from the thread of the dispatcher only,
+    /// read from other threads
+    QMutex methodsMutex_;
+    /// Emissions received from other threads
+    EmissionQueue emissionQueue_;
+    /// Non-zero if a wake-up event was posted and not yet processed
+    QAtomicInt wakeUpPosted_;
+};
+
+//------------------------------------------------------------------------------
+/// @brief Native connection between a signal and a QObject method with
+/// mismatched signatures.
+///
+/// The signal is connected to the adapter, which builds the argument array of
+/// the target method and invokes it through @c QMetaObject::metacall without
+/// any Lua involvement: each target argument is either a signal argument,
+/// passed as is if the types match and converted through QVariant otherwise,
+/// or a constant supplied at connection time and converted once.
+/// Emissions whose arguments cannot be converted, and calls the target does
+/// not handle, are reported through @c qWarning and the method is not invoked.
+/// Adapters are children of the target object: they live in the target's
+/// thread, signals emitted from other threads are queued by Qt, and are
+/// deleted together with the target.
+class ArgumentAdapter : public QObject {
+public:
+    /// Source of a target method argument
+    struct Source {
+        /// Index of signal argument, negative for constants
+        int signalArg_;
+        /// Constant value
+        QVariant constant_;
+        /// Set if constant was converted to the type of the target argument
+        bool converted_;
+        Source( int signalArg = -1, const QVariant& constant = QVariant() )
+            : signalArg_( signalArg ), constant_( constant ), converted_( true ) {}
+    };
+    typedef QList< Source > Sources;
+    /// @brief Constructor: the adapter is a child of the target object.
+    /// @param sender source QObject
+    /// @param signalIdx signal index
+    /// @param target target QObject
+    /// @param methodIdx target method index
+    /// @param sources one element per target method parameter
+    ArgumentAdapter( QObject* sender, int signalIdx, QObject* target, int methodIdx,
+                     const Sources& sources );
+    /// @brief Check that each source can be converted to the type of the
+    /// corresponding target parameter.
+    /// @param error set to a description of the first error found
+    bool Validate( QString& error ) const;
+    /// Connect signal to adapter
+    bool Connect();
+    /// Return @c true if adapter forwards signal to target method
+    bool Matches( QObject* sender, int signalIdx, int methodIdx ) const {
+        return sender == sender_ && signalIdx == signalIdx_ && methodIdx == methodIdx_;
+    }
+    /// Forward signal to target method
+    int qt_metacall( QMetaObject::Call c, int id, void **arguments );
+    /// @brief Delete adapters forwarding signal to target method.
+    /// @return @c true if at least one adapter was found
+    static bool Disconnect( QObject* sender, int signalIdx, QObject* target, int methodIdx );
+private:
+    /// Method ids
+    enum { FORWARD_METHOD = 0, SENDER_DESTROYED_METHOD = 1 };
+    /// Source QObject
+    QObject* sender_;
+    /// Signal index
+    int signalIdx_;
+    /// Target method index
+    int methodIdx_;
+    /// Signal parameter types
+    QList< int > signalTypes_;
+    /// Target method parameter types
+    QList< int > targetTypes_;
+    /// Argument sources, constants are converted to target types
+    Sources sources_;
 };
 }
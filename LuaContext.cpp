@@ -23,10 +23,12 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <cassert>
+#include <cstring>
 #include <QMetaObject>
 #include <QSet>
 #include <QMetaType>
 #include <QMetaProperty>
+#include <QVarLengthArray>
 
 #include "LuaContext.h"
 
@@ -34,12 +36,23 @@ namespace qlua {
 //------------------------------------------------------------------------------
 LuaContext::LuaContext( lua_State* L ) : L_( L ), 
                                              wrappedContext_( false ), 
-                                             ownQObjects_( false ) {
+                                             ownQObjects_( false ),
+                                             wrapMode_( QOBJ_WRAP_TABLE ),
+                                             liveProperties_( false ),
+                                             directInvocation_( true ),
+                                             internKeys_( false ),
+                                             wrapperCacheRef_( LUA_NOREF ),
+                                             errorHandler_( 0 ),
+                                             luaErrorHandlerRef_( LUA_NOREF ),
+                                             waitFunctionRef_( LUA_NOREF ) {
         
     if( L_ == 0 ) L_ = luaL_newstate();
     else wrappedContext_ = true;
 
     luaL_openlibs( L_);
+    // values kept by C++ code, e.g. qlua::LuaTableRef, are accessed through
+    // the main thread: coroutines might be collected
+    SetLuaMainState( L_ );
     lua_newtable(L_);
 
     lua_pushstring( L_,  "connect" );
@@ -52,16 +65,58 @@ LuaContext::LuaContext( lua_State* L ) : L_( L ),
     lua_pushcclosure( L_, &LuaContext::QtDisconnect , 1);
     lua_settable( L_, -3 );
 
+    // qlua.wait is a Lua function which yields through QtWait: a coroutine
+    // suspended in qlua.wait has the function one level above the top of its
+    // call stack, and waiters are released when qlua.wait returns
+    lua_pushstring( L_,  "wait" );
+    luaL_loadstring( L_, "local wait, done = ...; "
+                         "return function( ... ) return done( wait( ... ) ) end" );
+    lua_pushlightuserdata( L_, this );
+    lua_pushcclosure( L_, &LuaContext::QtWait , 1);
+    lua_pushlightuserdata( L_, this );
+    lua_pushcclosure( L_, &LuaContext::QtWaitReturn , 1);
+    lua_call( L_, 2, 1 );
+    lua_pushvalue( L_, -1 );
+    waitFunctionRef_ = luaL_ref( L_, LUA_REGISTRYINDEX );
+    lua_settable( L_, -3 );
+
+    lua_pushstring( L_,  "onCallbackError" );
+    lua_pushlightuserdata( L_, this );
+    lua_pushcclosure( L_, &LuaContext::SetLuaCallbackErrorHandler , 1);
+    lua_settable( L_, -3 );
+
+    lua_pushstring( L_,  "callbackStats" );
+    lua_pushlightuserdata( L_, this );
+    lua_pushcclosure( L_, &LuaContext::CallbackStatsToLua , 1);
+    lua_settable( L_, -3 );
+
     lua_pushstring( L_,  "ownQObjects" );
     lua_pushlightuserdata( L_, this );
     lua_pushcclosure( L_, &LuaContext::SetQObjectsOwnership , 1);
     lua_settable( L_, -3 );
 
+    lua_pushstring( L_,  "typedArrays" );
+    lua_pushcfunction( L_, &LuaContext::EnableTypedArrays );
+    lua_settable( L_, -3 );
+
+    lua_pushstring( L_,  "typedArrayData" );
+    lua_pushcfunction( L_, &TypedArrayData );
+    lua_settable( L_, -3 );
+
     lua_pushstring( L_, "version" );
     lua_pushstring( L_, QLUA_VERSION );
     lua_settable( L_, -3 );
 
     lua_setglobal( L_, "qlua" );
+
+    // QObject identity cache: wrappers are weak values
+    lua_newtable( L_ );
+    lua_newtable( L_ );
+    lua_pushstring( L_, "v" );
+    lua_setfield( L_, -2, "__mode" );
+    lua_setmetatable( L_, -2 );
+    wrapperCacheRef_ = luaL_ref( L_, LUA_REGISTRYINDEX );
+
     dispatcher_.SetLuaContext( this );
     RegisterTypes();
 }
@@ -82,63 +137,67 @@ void LuaContext::AddQObject( QObject* obj,
         if( tableName ) lua_setglobal( L_, tableName ); 
         return;
     }
-    // create sets to filter methods/types
-    QSet< QString > mn;
-    QSet< QMetaMethod::MethodType > mt;
-    foreach( QString s, methodNames ) {
-        mn.insert( s );
-    }
-    foreach( QMetaMethod::MethodType t, methodTypes ) {
-        mt.insert( t );
+    // retrieve shared method information, created only once per class
+    const QMetaObject* mo = obj->metaObject();
+    const ClassInfo& ci = GetClassInfo( mo, mapper, methodNames, methodTypes );
+    if( wrapMode_ == QOBJ_WRAP_PROXY ) {
+        // proxy: a single userdata, methods and properties are resolved
+        // through the shared metatable
+        QObjectHandle* h = reinterpret_cast< QObjectHandle* >( lua_newuserdata( L_, sizeof( QObjectHandle ) ) );
+        h->obj_ = obj;
+        h->deleteMode_ = deleteMode;
+        lua_rawgeti( L_, LUA_REGISTRYINDEX, ci.metaTableRef_ );
+        lua_setmetatable( L_, -2 );
+        if( cache ) {
+            lua_pushvalue( L_, -1 );
+            objRefs_[ obj ] = luaL_ref( L_, LUA_REGISTRYINDEX );
+        }
+        if( tableName ) lua_setglobal( L_, tableName );
+        return;
     }
     // create Lua table wrapping QObject: methods and property are added to
     // this table together with a reference to the QObject instance
     lua_newtable( L_ );
-    // methods
-    const QMetaObject* mo = obj->metaObject();
-    for( int i = 0; i != mo->methodCount(); ++i ) {
-        QMetaMethod mm = mo->method( i );
-        QString name = mapper.map( mm.signature() );
-        if( !mn.isEmpty() && !mn.contains( name ) ) continue;
-        if( !mt.isEmpty() && !mt.contains( mm.methodType() ) ) continue;
-        typedef QList< QByteArray > Params;
-        Params params = mm.parameterTypes();
-        const QString returnType = mm.typeName();
-        objMethods_[ obj ][ name ].push_back( Method( obj,
-                                    mm, 
-                                    GenerateQArgWrappers( params ),
-                                    GenerateLArgWrapper( returnType ) ) );
-        if( objMethods_[ obj ][ name ].size() == 1 ) {
-            lua_pushstring( L_, name.toAscii().constData() );
-            lua_pushlightuserdata( L_, &( objMethods_[ obj ][ name ] ) );
-            lua_pushlightuserdata( L_, this );
-            lua_pushcclosure( L_, LuaContext::InvokeMethod, 2 );
-            lua_rawset( L_, -3 );
-        }                               
+    // methods: the Method lists are shared, each function is bound to the
+    // QObject instance through an upvalue
+    for( QMap< QByteArray, Methods >::const_iterator i = ci.methods_.begin();
+         i != ci.methods_.end(); ++i ) {
+        // method names are owned by the class information, which is never
+        // modified after creation
+        if( internKeys_ ) keyCache_.Push( L_, i.key().constData() );
+        else lua_pushlstring( L_, i.key().constData(), i.key().size() );
+        lua_pushlightuserdata( L_, const_cast< Methods* >( &i.value() ) );
+        lua_pushlightuserdata( L_, this );
+        lua_pushlightuserdata( L_, obj );
+        lua_pushcclosure( L_, LuaContext::InvokeMethod, 3 );
+        lua_rawset( L_, -3 );
     }
-    // reference to QObject added as userdata (pointer to pointer to QObject);
+    // reference to QObject added as userdata (pointer to QObjectHandle);
     // note that it is not possible to use light userdata because it is 
     // not garbage collected
     lua_pushstring( L_, "qobject__" );
-    QObject** pObj = reinterpret_cast< QObject** >( lua_newuserdata( L_, sizeof( QObject* ) ) );
-    *pObj = obj;
-    // assign metatable with __gc method to delete QObject if/when
+    QObjectHandle* h = reinterpret_cast< QObjectHandle* >( lua_newuserdata( L_, sizeof( QObjectHandle ) ) );
+    h->obj_ = obj;
+    h->deleteMode_ = deleteMode;
+    // assign shared metatable with __gc method to delete QObject if/when
     // required
-    lua_newtable( L_ ); // push metatable;
-    lua_pushlightuserdata( L_, obj );
-    lua_pushlightuserdata( L_, this );
-    lua_pushinteger( L_, int( deleteMode ) ); 
-    lua_pushcclosure( L_, &LuaContext::DeleteObject, 3 ); // push __gc method
-    lua_setfield( L_, -2, "__gc" ); // set table['__gc'] = function
+    lua_rawgeti( L_, LUA_REGISTRYINDEX, ci.metaTableRef_ );
     lua_setmetatable( L_, -2 ); // set metatable for userdata 
     lua_settable( L_, -3 ); // table['qobject__']= <user data> == QObject*
 
-    // properties
-    for( int i = 0; i != mo->propertyCount(); ++i ) {
-        QMetaProperty mp = mo->property( i );
-        lua_pushstring( L_, mp.name() );
-        VariantToLuaValue( mp.read( obj ), L_ );
-        lua_rawset( L_, -3 );
+    // properties: either read through the shared metatable when accessed
+    // or copied into the table
+    if( liveProperties_ ) {
+        lua_rawgeti( L_, LUA_REGISTRYINDEX, ci.tableMetaTableRef_ );
+        lua_setmetatable( L_, -2 );
+    } else {
+        for( int i = 0; i != mo->propertyCount(); ++i ) {
+            QMetaProperty mp = mo->property( i );
+            if( internKeys_ ) keyCache_.Push( L_, mp.name() );
+            else lua_pushstring( L_, mp.name() );
+            VariantToLuaValue( mp.read( obj ), L_ );
+            lua_rawset( L_, -3 );
+        }
     }
     // if caching enabled create Lua reference for QObject table and
     // add it to object->reference table
@@ -150,10 +209,133 @@ void LuaContext::AddQObject( QObject* obj,
     if( tableName ) lua_setglobal( L_, tableName );
 }
 
+//------------------------------------------------------------------------------
+void LuaContext::PushQObject( QObject* obj ) {
+    if( obj == 0 ) {
+        lua_pushnil( L_ );
+        return;
+    }
+    lua_rawgeti( L_, LUA_REGISTRYINDEX, wrapperCacheRef_ );
+    lua_pushlightuserdata( L_, obj );
+    lua_rawget( L_, -2 );
+    if( !lua_isnil( L_, -1 ) ) {
+        lua_remove( L_, -2 ); // cache
+        return;
+    }
+    lua_pop( L_, 1 );
+    AddQObject( obj );
+    lua_pushlightuserdata( L_, obj );
+    lua_pushvalue( L_, -2 );
+    lua_rawset( L_, -4 ); // cache[ obj ] = wrapper
+    lua_remove( L_, -2 ); // cache
+    // remove wrapper from cache when object destroyed: a new object allocated
+    // at the same address must not be mapped to the old wrapper
+    dispatcher_.WatchObject( obj );
+}
+
+//------------------------------------------------------------------------------
+void LuaContext::QObjectDestroyed( QObject* obj ) {
+    lua_rawgeti( L_, LUA_REGISTRYINDEX, wrapperCacheRef_ );
+    lua_pushlightuserdata( L_, obj );
+    lua_pushnil( L_ );
+    lua_rawset( L_, -3 );
+    lua_pop( L_, 1 );
+}
+
+//------------------------------------------------------------------------------
+const LuaContext::ClassInfo& LuaContext::GetClassInfo( 
+                             const QMetaObject* mo,
+                             const ILuaSignatureMapper& mapper,
+                             const QStringList& methodNames,
+                             const QList< QMetaMethod::MethodType >& methodTypes ) {
+    // configuration key: mappers are identified by their key if any,
+    // otherwise by the names they map the methods to
+    const QString mapperKey = mapper.cacheKey();
+    QString config;
+    if( !mapperKey.isEmpty() ) config = 'k' + mapperKey;
+    else {
+        config = 'm';
+        for( int i = 0; i != mo->methodCount(); ++i ) {
+            config += mapper.map( mo->method( i ).signature() ) + ',';
+        }
+    }
+    config += '|' + methodNames.join( "," ) + '|';
+    foreach( QMetaMethod::MethodType t, methodTypes ) {
+        config += QString::number( int( t ) ) + ',';
+    }
+    const QPair< const QMetaObject*, QString > key( mo, config );
+    ClassInfoMap::const_iterator ci = classInfo_.find( key );
+    if( ci != classInfo_.end() ) return **ci;
+    // create sets to filter methods/types
+    QSet< QString > mn;
+    QSet< QMetaMethod::MethodType > mt;
+    foreach( QString s, methodNames ) {
+        mn.insert( s );
+    }
+    foreach( QMetaMethod::MethodType t, methodTypes ) {
+        mt.insert( t );
+    }
+    ClassInfo* info = new ClassInfo;
+    for( int i = 0; i != mo->methodCount(); ++i ) {
+        QMetaMethod mm = mo->method( i );
+        QString name = mapper.map( mm.signature() );
+        if( !mn.isEmpty() && !mn.contains( name ) ) continue;
+        if( !mt.isEmpty() && !mt.contains( mm.methodType() ) ) continue;
+        typedef QList< QByteArray > Params;
+        Params params = mm.parameterTypes();
+        const QByteArray returnType = mm.typeName();
+        info->methods_[ name.toAscii() ].overloads_.push_back( Method( mm, 
+                                    GenerateQArgWrappers( params ),
+                                    GenerateLArgWrapper( returnType ) ) );
+    }
+    // properties: the index table maps each property name to its position in
+    // the property array; proxy method functions are cached in the same table
+    // when first accessed
+    lua_newtable( L_ );
+    for( int i = 0; i != mo->propertyCount(); ++i ) {
+        info->properties_.push_back( mo->property( i ) );
+        lua_pushinteger( L_, i );
+        lua_setfield( L_, -2, mo->property( i ).name() );
+    }
+    const int indexTable = lua_gettop( L_ );
+    // metatable shared by all the 'qobject__' userdata and proxies: __gc method
+    // deletes QObject if/when required, __index resolves proxy methods and
+    // properties, __newindex writes properties
+    lua_newtable( L_ );
+    lua_pushlightuserdata( L_, this );
+    lua_pushcclosure( L_, &LuaContext::DeleteObject, 1 ); // push __gc method
+    lua_setfield( L_, -2, "__gc" ); // set table['__gc'] = function
+    lua_pushlightuserdata( L_, this );
+    lua_pushlightuserdata( L_, info );
+    lua_pushvalue( L_, indexTable );
+    lua_pushcclosure( L_, &LuaContext::ProxyIndex, 3 );
+    lua_setfield( L_, -2, "__index" );
+    lua_pushlightuserdata( L_, info );
+    lua_pushvalue( L_, indexTable );
+    lua_pushcclosure( L_, &LuaContext::PropertyNewIndex, 2 );
+    lua_setfield( L_, -2, "__newindex" );
+    // marker identifying userdata referencing QObjects
+    lua_pushboolean( L_, 1 );
+    lua_setfield( L_, -2, "qobject__" );
+    info->metaTableRef_ = luaL_ref( L_, LUA_REGISTRYINDEX );
+    // metatable shared by all the tables with live properties
+    lua_newtable( L_ );
+    lua_pushlightuserdata( L_, info );
+    lua_pushvalue( L_, indexTable );
+    lua_pushcclosure( L_, &LuaContext::PropertyIndex, 2 );
+    lua_setfield( L_, -2, "__index" );
+    lua_pushlightuserdata( L_, info );
+    lua_pushvalue( L_, indexTable );
+    lua_pushcclosure( L_, &LuaContext::PropertyNewIndex, 2 );
+    lua_setfield( L_, -2, "__newindex" );
+    info->tableMetaTableRef_ = luaL_ref( L_, LUA_REGISTRYINDEX );
+    lua_pop( L_, 1 ); // index table
+    classInfo_.insert( key, info );
+    return *info;
+}
+
 //------------------------------------------------------------------------------
 void LuaContext::RemoveObject( QObject* obj ) {
-    // remove object from database of registered objects
-    objMethods_.remove( obj );
     // if an associated Lua reference exists remove reference
     if( objRefs_.contains( obj ) ) {
         luaL_unref( L_, LUA_REGISTRYINDEX, objRefs_[ obj ] );
@@ -164,13 +346,14 @@ void LuaContext::RemoveObject( QObject* obj ) {
 //------------------------------------------------------------------------------
 // Invoked by Lua's __gc
 int LuaContext::DeleteObject( lua_State* L ) {
-    // upvalues in closure: pointer to QObject, pointer to LuaContext, delete mode
-    QObject* obj = reinterpret_cast< QObject* >( lua_touserdata( L, lua_upvalueindex( 1 ) ) );
-    LuaContext* lc = reinterpret_cast< LuaContext* >( lua_touserdata( L, lua_upvalueindex( 2 ) ) );
-    ObjectDeleteMode dm = ObjectDeleteMode( lua_tointeger( L, lua_upvalueindex( 3 ) ) );
+    // upvalue in closure: pointer to LuaContext; QObject and delete mode are
+    // stored in the userdata
+    LuaContext* lc = reinterpret_cast< LuaContext* >( lua_touserdata( L, lua_upvalueindex( 1 ) ) );
+    const QObjectHandle* h = reinterpret_cast< QObjectHandle* >( lua_touserdata( L, 1 ) );
+    QObject* obj = h->obj_;
     lc->RemoveObject( obj );
-    if( dm == QOBJ_IMMEDIATE_DELETE ) delete obj;
-    else if( dm == QOBJ_DELETE_LATER ) obj->deleteLater();    
+    if( h->deleteMode_ == QOBJ_IMMEDIATE_DELETE ) delete obj;
+    else if( h->deleteMode_ == QOBJ_DELETE_LATER ) obj->deleteLater();    
     return 0;
 }
 
@@ -178,113 +361,204 @@ int LuaContext::DeleteObject( lua_State* L ) {
 // Register additional types not automatically available through Qt's mata-type
 // environment
 void LuaContext::RegisterTypes() {
-    qRegisterMetaType< QList< double > >( QLUA_LIST_FLOAT64 );
-    qRegisterMetaType< QList< float > > ( QLUA_LIST_FLOAT32 );
-    qRegisterMetaType< QList< int > >   ( QLUA_LIST_INT );
-    qRegisterMetaType< QList< short > >( QLUA_LIST_SHORT );
-    qRegisterMetaType< QVector< double > >( QLUA_VECTOR_FLOAT64 );
-    qRegisterMetaType< QVector< float > >( QLUA_VECTOR_FLOAT32 );
-    qRegisterMetaType< QVector< int > >( QLUA_VECTOR_INT );
-    qRegisterMetaType< QVector< short > >( QLUA_VECTOR_SHORT );
-    qRegisterMetaType< QList< QString > >( QLUA_STRING_LIST );
+    // the constructor registry registers list and vector types the first
+    // time it is accessed
+    ArgConstructorRegistry::Instance();
+}
+
+//------------------------------------------------------------------------------
+LuaContext::SignalInfo LuaContext::ResolveSignal( const QMetaObject* mo,
+                                                  const char* signal ) {
+    const SignatureKey key( mo, signal );
+    QHash< SignatureKey, SignalInfo >::const_iterator i = signalCache_.find( key );
+    if( i != signalCache_.end() && std::strcmp( i->signature_.constData(), signal ) == 0 ) return *i;
+    if( signalCache_.size() >= MAX_CACHED_SIGNATURES ) signalCache_.clear();
+    SignalInfo si;
+    si.signature_ = signal;
+    si.normalized_ = QMetaObject::normalizedSignature( signal );
+    si.index_ = mo->indexOfSignal( si.normalized_.constData() );
+    if( si.index_ >= 0 ) {
+        const QList< QByteArray > params = mo->method( si.index_ ).parameterTypes();
+        for( QList< QByteArray >::const_iterator p = params.begin();
+             p != params.end(); ++p ) {
+            si.types_.push_back( LArgWrapper( *p ) );
+            if( !si.types_.back().IsValid() && si.unknownType_.isEmpty() ) {
+                si.unknownType_ = *p;
+            }
+        }
+    }
+    signalCache_.insert( key, si );
+    return si;
+}
+
+//------------------------------------------------------------------------------
+int LuaContext::ResolveMethod( const QMetaObject* mo, const char* method ) {
+    const SignatureKey key( mo, method );
+    QHash< SignatureKey, MethodIndexInfo >::const_iterator i = methodCache_.find( key );
+    if( i != methodCache_.end() && std::strcmp( i->first.constData(), method ) == 0 ) {
+        return i->second;
+    }
+    if( methodCache_.size() >= MAX_CACHED_SIGNATURES ) methodCache_.clear();
+    const int index = mo->indexOfMethod( QMetaObject::normalizedSignature( method ) );
+    methodCache_.insert( key, MethodIndexInfo( QByteArray( method ), index ) );
+    return index;
 }
 
 //------------------------------------------------------------------------------
 int LuaContext::QtConnect( lua_State* L ) {
     // extract LuaContext from closure 
     LuaContext& lc = *reinterpret_cast< LuaContext* >( lua_touserdata( L, lua_upvalueindex( 1 ) ) );
-    if( lua_gettop( L ) != 3 && lua_gettop( L ) != 4  ) {
-        RaiseLuaError( L, "qlua.connect: Three or four parameters required" );
+    if( lua_gettop( L ) < 3 || lua_gettop( L ) > 5 ) {
+        RaiseLuaError( L, "qlua.connect: Three to five parameters required" );
         return 0;
     }
-    if( !lua_istable( L, 1 ) && !lua_islightuserdata( L, 1 ) ) {
+    if( !lua_istable( L, 1 ) && !lua_isuserdata( L, 1 ) ) {
         RaiseLuaError( L, "First parameter to function 'qlua.connect' is not a table nor a pointer" );
         return 0;
     }
 
-    // get pointer to QObject through either Lua table or direct access to pointer data
-    QObject* obj = 0;
-    if( lua_istable( L, 1 ) ) {
-        lua_pushstring( L, "qobject__" );
-        lua_gettable( L, 1 );
-        if( lua_isnil( L, -1 ) ) {
-            RaiseLuaError( L, "qlua.connect: Wrong table format: reference to QObject not found" );
-            return 0;
-        }
-        obj = *reinterpret_cast< QObject** >( lua_touserdata( L, -1 ) );
-    } else obj = reinterpret_cast< QObject* >( lua_touserdata( L, 1 ) );
+    // get pointer to QObject through either Lua table, proxy or direct access to pointer data
+    QObject* obj = LuaValueToQObject( L, 1 );
+    if( !obj ) {
+        RaiseLuaError( L, "qlua.connect: Wrong table format: reference to QObject not found" );
+        return 0;
+    }
     
     // signal signature from Lua
     const char* signal = lua_tostring( L, 2 );
-    //extract signal arguments info
-    const QMetaObject* mo = obj->metaObject();
-    QString signalSignature = QMetaObject::normalizedSignature( signal );
-    const int signalIndex = mo->indexOfSignal( signalSignature.toAscii().constData() );
-    if( signalIndex < 0 ) {
-        RaiseLuaError( L, "Signal '" + signalSignature + "' not found" );
+    if( !signal ) {
+        RaiseLuaError( L, "qlua.connect: Parameter 2 must be a signal signature" );
+        return 0;
+    }
+    //extract signal index and arguments info
+    const SignalInfo si = lc.ResolveSignal( obj->metaObject(), signal );
+    if( si.index_ < 0 ) {
+        RaiseLuaError( L, "Signal '" + QString( si.normalized_ ) + "' not found" );
         return 0;
     } 
-    QMetaMethod mm = mo->method( signalIndex );
-    //extract signal's arguments info
-    QList< QByteArray > params = mm.parameterTypes();
-    QList< LArgWrapper > types;
-    for( QList< QByteArray >::const_iterator i = params.begin();
-         i != params.end(); ++i ) {
-             types.push_back( LArgWrapper( i->constData() ) );
-    }
-    // if Lua function create reference associated with function
-    // and connect signal to dynamic method which will invoke the
-    // passed function when the signal is triggered;
-    // note that the current implementation creates a new reference
-    // each time a function is connected to a signal: connecting 
-    // twice the same function will cause the function to be called
-    // twice whenever a signal is emitted
+    if( !si.unknownType_.isEmpty() ) {
+        RaiseLuaError( L, "qlua.connect: Type " + QString( si.unknownType_ ) + " unknown" );
+        return 0;
+    }
+    const int signalIndex = si.index_;
+    const CBackParameterTypes& types = si.types_;
+    // if Lua function connect signal to dynamic method which will invoke the
+    // passed function when the signal is triggered; the same method is
+    // shared by all the connections of a function to signals with the same
+    // signature: connecting twice the same function will cause the function
+    // to be called twice whenever a signal is emitted;
+    // an optional table specifies the delivery policy:
+    // { delivery = 'immediate' | 'batched' | 'latest', interval = <ms>, capacity = <n>,
+    //   weak = <boolean> }
+    // or adds the function to the handlers of the signal, invoked by priority:
+    // { priority = <n> }
     if( lua_isfunction( L, 3 ) ) {
-        //push lua callback on top of stack
-        lua_pushvalue( L, 3 );
-        const int luaRef = luaL_ref( L, LUA_REGISTRYINDEX );
-        lc.dispatcher_.Connect( obj, signalIndex, types, luaRef );
-    // else if light user data interpret it as QObject pointer and
+        DeliveryOptions options;
+        if( lua_gettop( L ) == 4 && lua_istable( L, 4 ) ) {
+            lua_getfield( L, 4, "priority" );
+            if( lua_isnumber( L, -1 ) ) {
+                const int priority = int( lua_tointeger( L, -1 ) );
+                lua_pop( L, 1 );
+                lua_getfield( L, 4, "delivery" );
+                lua_getfield( L, 4, "weak" );
+                if( !lua_isnil( L, -2 ) || !lua_isnil( L, -1 ) ) {
+                    RaiseLuaError( L, "qlua.connect: 'priority' cannot be combined with "
+                                      "'delivery' or 'weak'" );
+                    return 0;
+                }
+                lua_pop( L, 2 );
+                lc.dispatcher_.ConnectHandler( L, obj, signalIndex, types, 3, priority );
+                return 0;
+            }
+            lua_pop( L, 1 );
+            lua_getfield( L, 4, "delivery" );
+            const char* delivery = lua_isstring( L, -1 ) ? lua_tostring( L, -1 ) : "immediate";
+            if( std::strcmp( delivery, "batched" ) == 0 ) {
+                options.mode_ = DeliveryOptions::DELIVER_BATCHED;
+            } else if( std::strcmp( delivery, "latest" ) == 0 ) {
+                options.mode_ = DeliveryOptions::DELIVER_LATEST;
+            } else if( std::strcmp( delivery, "immediate" ) != 0 ) {
+                RaiseLuaError( L, "qlua.connect: Unknown delivery policy '" + QString( delivery ) + "'" );
+                return 0;
+            }
+            lua_pop( L, 1 );
+            lua_getfield( L, 4, "interval" );
+            if( lua_isnumber( L, -1 ) ) options.interval_ = qMax( 0, int( lua_tointeger( L, -1 ) ) );
+            lua_pop( L, 1 );
+            lua_getfield( L, 4, "capacity" );
+            if( lua_isnumber( L, -1 ) ) options.capacity_ = qMax( 1, int( lua_tointeger( L, -1 ) ) );
+            lua_pop( L, 1 );
+            lua_getfield( L, 4, "weak" );
+            options.weak_ = lua_toboolean( L, -1 ) != 0;
+            lua_pop( L, 1 );
+        }
+        lc.dispatcher_.Connect( L, obj, signalIndex, types, 3, options );
+    // else if QObject pointer, table or proxy extract QObject pointer and
     // use the standard QObject::connect function 
-    } else if( lua_islightuserdata( L, 3 ) ) {
+    } else if( lua_isuserdata( L, 3 ) || lua_istable( L, 3 ) ) {
         if( lua_gettop( L ) < 4 || !lua_isstring( L, 4 ) ) {
             RaiseLuaError( L, "qlua.connect: missing target method" );
             return 0;
         }
         //fetch QObject* and method/signal signature to invoke in parameter 4
-        QObject* targetObj = reinterpret_cast< QObject* >( lua_touserdata( L, 3 ) );
+        QObject* targetObj = LuaValueToQObject( L, 3 );
+        if( !targetObj ) {
+            RaiseLuaError( L, "qlua.connect: Wrong table format: reference to QObject not found" );
+            return 0;
+        }
         const char* targetMethod = lua_tostring( L, 4 );
-        const QMetaObject* mo = targetObj->metaObject();
-        const int targetMethodIdx = mo->indexOfMethod( QMetaObject::normalizedSignature( targetMethod ) ); 
+        const int targetMethodIdx = lc.ResolveMethod( targetObj->metaObject(), targetMethod ); 
         if( targetMethodIdx < 0 ) {
             RaiseLuaError( L, "Method '" + QString( targetMethod ) + "' not found"  );
             return 0;
         }
-        QMetaObject::connect( obj, signalIndex, targetObj, targetMethodIdx );
-        return 0;
-    // else if table extract QObject pointer and call QObject::connect 
-    } else if( lua_istable( L, 3 ) ) {
-        if( lua_gettop( L ) < 4 || !lua_isstring( L, 4 ) ) {
-            lua_pushstring( L, "qlua.connect: missing target method" );
-            lua_error( L );
+        // matching signatures and no argument mapping: standard connection
+        const QMetaObject* tmo = targetObj->metaObject();
+        if( lua_gettop( L ) < 5 && QMetaObject::checkConnectArgs( 
+                                       obj->metaObject()->method( signalIndex ).signature(),
+                                       tmo->method( targetMethodIdx ).signature() ) ) {
+            QMetaObject::connect( obj, signalIndex, targetObj, targetMethodIdx );
             return 0;
         }
-        //table wrapping QObject*: extract qobject__ field and signal/slot signature in parameter 4 
-        lua_pushstring( L, "qobject__" );
-        lua_gettable( L, 1 );
-        if( lua_isnil( L, -1 ) ) {
-            RaiseLuaError( L, "qlua.connect: Wrong table format: reference to QObject not found" );
-            return 0;
+        // otherwise forward signal through native adapter; the optional fifth
+        // parameter maps each target argument to either a signal argument
+        // index or a constant stored in a table e.g. { 2, { 'constant' }, 1 };
+        // by default signal arguments are passed in the same order
+        ArgumentAdapter::Sources sources;
+        if( lua_gettop( L ) == 5 ) {
+            if( !lua_istable( L, 5 ) ) {
+                RaiseLuaError( L, "qlua.connect: Parameter 5 must be a table" );
+                return 0;
+            }
+            const int n = LuaArrayLength( L, 5 );
+            for( int i = 1; i <= n; ++i ) {
+                lua_rawgeti( L, 5, i );
+                if( lua_isnumber( L, -1 ) ) {
+                    sources.push_back( ArgumentAdapter::Source( int( lua_tointeger( L, -1 ) ) - 1 ) );
+                } else if( lua_istable( L, -1 ) ) {
+                    lua_rawgeti( L, -1, 1 );
+                    sources.push_back( ArgumentAdapter::Source( -1, LuaValueToQVariant( L, -1 ) ) );
+                    lua_pop( L, 1 );
+                } else {
+                    lua_pop( L, 1 );
+                    RaiseLuaError( L, "qlua.connect: Argument mapping elements must be numbers or tables" );
+                    return 0;
+                }
+                lua_pop( L, 1 );
+            }
+        } else {
+            const int numParams = tmo->method( targetMethodIdx ).parameterTypes().size();
+            for( int i = 0; i != numParams; ++i ) sources.push_back( ArgumentAdapter::Source( i ) );
         }
-        QObject* targetObj = *reinterpret_cast< QObject** >( lua_touserdata( L, -1 ) );
-        const char* targetMethod = lua_tostring( L, 4 );
-        const QMetaObject* mo = targetObj->metaObject();
-        const int targetMethodIdx = mo->indexOfMethod( QMetaObject::normalizedSignature( targetMethod ) ); 
-        if( targetMethodIdx < 0 ) {
-            RaiseLuaError( L, "Method '" + QString( targetMethod ) + "' not found" );
+        ArgumentAdapter* adapter = new ArgumentAdapter( obj, signalIndex, targetObj,
+                                                        targetMethodIdx, sources );
+        QString error;
+        if( !adapter->Validate( error ) || !adapter->Connect() ) {
+            delete adapter;
+            if( error.isEmpty() ) error = "Cannot connect signal";
+            RaiseLuaError( L, "qlua.connect: " + error );
             return 0;
         }
-        QMetaObject::connect( obj, signalIndex, targetObj, targetMethodIdx );
         return 0;
     } else {
         RaiseLuaError( L, "qlua.connect: Parameter 3 must be a pointer to QObject, a QObject instance or a lua function" );
@@ -293,6 +567,54 @@ int LuaContext::QtConnect( lua_State* L ) {
     return 0;
 }
 
+//------------------------------------------------------------------------------
+int LuaContext::QtWait( lua_State* L ) {
+    // extract LuaContext from closure 
+    LuaContext& lc = *reinterpret_cast< LuaContext* >( lua_touserdata( L, lua_upvalueindex( 1 ) ) );
+    if( lua_gettop( L ) != 2 ) {
+        RaiseLuaError( L, "qlua.wait: Two parameters required" );
+        return 0;
+    }
+    if( lua_pushthread( L ) ) {
+        RaiseLuaError( L, "qlua.wait: Must be called from a coroutine" );
+        return 0;
+    }
+    lua_pop( L, 1 );
+    QObject* obj = LuaValueToQObject( L, 1 );
+    if( !obj ) {
+        RaiseLuaError( L, "qlua.wait: Wrong table format: reference to QObject not found" );
+        return 0;
+    }
+    const char* signal = lua_tostring( L, 2 );
+    if( !signal ) {
+        RaiseLuaError( L, "qlua.wait: Parameter 2 must be a signal signature" );
+        return 0;
+    }
+    const SignalInfo si = lc.ResolveSignal( obj->metaObject(), signal );
+    if( si.index_ < 0 ) {
+        RaiseLuaError( L, "Signal '" + QString( si.normalized_ ) + "' not found" );
+        return 0;
+    } 
+    if( !si.unknownType_.isEmpty() ) {
+        RaiseLuaError( L, "qlua.wait: Type " + QString( si.unknownType_ ) + " unknown" );
+        return 0;
+    }
+    if( !lc.dispatcher_.Wait( L, obj, si.index_, si.types_ ) ) {
+        RaiseLuaError( L, "qlua.wait: Cannot connect to signal '" + QString( si.normalized_ ) + "'" );
+        return 0;
+    }
+    // signal arguments are returned by lua_resume
+    return lua_yield( L, 0 );
+}
+
+//------------------------------------------------------------------------------
+int LuaContext::QtWaitReturn( lua_State* L ) {
+    LuaContext& lc = *reinterpret_cast< LuaContext* >( lua_touserdata( L, lua_upvalueindex( 1 ) ) );
+    // the waiter is still connected if the coroutine was resumed from Lua
+    lc.dispatcher_.WaitReturned( L );
+    return lua_gettop( L );
+}
+
 //------------------------------------------------------------------------------
 int LuaContext::QtDisconnect( lua_State* L ) {
     LuaContext& lc = *reinterpret_cast< LuaContext* >( lua_touserdata( L, lua_upvalueindex( 1 ) ) );
@@ -300,79 +622,92 @@ int LuaContext::QtDisconnect( lua_State* L ) {
         RaiseLuaError( L, "qlua.disconnect: Three or four parameters required" );
         return 0;
     }
-    if( !lua_istable( L, 1 ) && !lua_islightuserdata( L, 1 ) ) {
+    if( !lua_istable( L, 1 ) && !lua_isuserdata( L, 1 ) ) {
         RaiseLuaError( L, "First parameter to function 'qlua.disconnect' is not a table nor a pointer" );
         return 0;
     }
-    QObject* obj = 0;
-    if( lua_istable( L, 1 ) ) {
-        lua_pushstring( L, "qobject__" );
-        lua_gettable( L, 1 );
-        if( lua_isnil( L, -1 ) ) {
-            RaiseLuaError( L, "qlua.connect: Wrong table format: reference to QObject not found" );
-            return 0;
-        }
-        obj = *reinterpret_cast< QObject** >( lua_touserdata( L, -1 ) );
-    } else obj = reinterpret_cast< QObject* >( lua_touserdata( L, 1 ) );
+    QObject* obj = LuaValueToQObject( L, 1 );
+    if( !obj ) {
+        RaiseLuaError( L, "qlua.disconnect: Wrong table format: reference to QObject not found" );
+        return 0;
+    }
     
     const char* signal = lua_tostring( L, 2 );
-    //extract signal arguments info
-    const QMetaObject* mo = obj->metaObject();
-    QString signalSignature = QMetaObject::normalizedSignature( signal );
-
-    const int signalIndex = mo->indexOfSignal( signalSignature.toAscii().constData() );
-    if( signalIndex < 0 ) {
-        RaiseLuaError( L, "Signal '" + signalSignature + "' not found" );
+    if( !signal ) {
+        RaiseLuaError( L, "qlua.disconnect: Parameter 2 must be a signal signature" );
+        return 0;
+    }
+    const SignalInfo si = lc.ResolveSignal( obj->metaObject(), signal );
+    if( si.index_ < 0 ) {
+        RaiseLuaError( L, "Signal '" + QString( si.normalized_ ) + "' not found" );
         return 0;
     } 
+    const int signalIndex = si.index_;
     if( lua_isfunction( L, 3 ) ) {
-        lc.dispatcher_.Disconnect( obj, signalIndex, 3 ); 
-    } else if( lua_islightuserdata( L, 3 ) ) {
+        lc.dispatcher_.Disconnect( L, obj, signalIndex, 3 );
+    } else if( lua_isuserdata( L, 3 ) || lua_istable( L, 3 ) ) {
         if( lua_gettop( L ) < 4 || !lua_isstring( L, 4 ) ) {
-            RaiseLuaError( L, "qlua.connect: missing target method" );
+            RaiseLuaError( L, "qlua.disconnect: missing target method" );
             return 0;
         }
         //fetch QObject* and method/signal signature to invoke in parameter 4
-        QObject* targetObj = reinterpret_cast< QObject* >( lua_touserdata( L, 3 ) );
-        const char* targetMethod = lua_tostring( L, 4 );
-        const QMetaObject* mo = targetObj->metaObject();
-        const int targetMethodIdx = mo->indexOfMethod( QMetaObject::normalizedSignature( targetMethod ) ); 
-        if( targetMethodIdx < 0 ) {
-            RaiseLuaError( L, "Method '" + QString( targetMethod ) + "' not found"  );
-            return 0;
-        }
-        QMetaObject::disconnect( obj, signalIndex, targetObj, targetMethodIdx );
-        return 0;
-    } else if( lua_istable( L, 3 ) ) {
-        if( lua_gettop( L ) < 4 || !lua_isstring( L, 4 ) ) {
-            lua_pushstring( L, "qlua.connect: missing target method" );
-            lua_error( L );
-            return 0;
-        }
-        //table wrapping QObject*: extract qobject__ field and signal/slot signature in parameter 4 
-        lua_pushstring( L, "qobject__" );
-        lua_gettable( L, 1 );
-        if( lua_isnil( L, -1 ) ) {
-            RaiseLuaError( L, "qlua.connect: Wrong table format: reference to QObject not found" );
+        QObject* targetObj = LuaValueToQObject( L, 3 );
+        if( !targetObj ) {
+            RaiseLuaError( L, "qlua.disconnect: Wrong table format: reference to QObject not found" );
             return 0;
         }
-        QObject* targetObj = *reinterpret_cast< QObject** >( lua_touserdata( L, -1 ) );
         const char* targetMethod = lua_tostring( L, 4 );
-        const QMetaObject* mo = targetObj->metaObject();
-        const int targetMethodIdx = mo->indexOfMethod( QMetaObject::normalizedSignature( targetMethod ) ); 
+        const int targetMethodIdx = lc.ResolveMethod( targetObj->metaObject(), targetMethod ); 
         if( targetMethodIdx < 0 ) {
-            RaiseLuaError( L, "Method '" + QString( targetMethod ) + "' not found" );
+            RaiseLuaError( L, "Method '" + QString( targetMethod ) + "' not found"  );
             return 0;
         }
+        // remove both standard and adapted connections
+        ArgumentAdapter::Disconnect( obj, signalIndex, targetObj, targetMethodIdx );
         QMetaObject::disconnect( obj, signalIndex, targetObj, targetMethodIdx );
         return 0;
     } else {
-        RaiseLuaError( L, "qlua.connect: Parameter 3 must be a pointer to QObject, a QObject instance or a lua function" );
+        RaiseLuaError( L, "qlua.disconnect: Parameter 3 must be a pointer to QObject, a QObject instance or a lua function" );
+        return 0;
+    }
+    return 0;
+}
+
+//------------------------------------------------------------------------------
+void LuaContext::ReportCallbackError( lua_State* L, const char* error ) {
+    if( !error ) error = "(error object is not a string)";
+    if( luaErrorHandlerRef_ != LUA_NOREF ) {
+        lua_rawgeti( L, LUA_REGISTRYINDEX, luaErrorHandlerRef_ );
+        lua_pushstring( L, error );
+        // errors raised by the handler itself are discarded
+        if( lua_pcall( L, 1, 0, 0 ) != 0 ) lua_pop( L, 1 );
+    } else if( errorHandler_ ) errorHandler_( error );
+}
+
+//------------------------------------------------------------------------------
+int LuaContext::SetLuaCallbackErrorHandler( lua_State* L ) {
+    LuaContext& lc = *reinterpret_cast< LuaContext* >( lua_touserdata( L, lua_upvalueindex( 1 ) ) );
+    if( !lua_isnoneornil( L, 1 ) && !lua_isfunction( L, 1 ) ) {
+        RaiseLuaError( L, "qlua.onCallbackError: Parameter must be a function or nil" );
         return 0;
     }
+    luaL_unref( L, LUA_REGISTRYINDEX, lc.luaErrorHandlerRef_ );
+    lc.luaErrorHandlerRef_ = LUA_NOREF;
+    if( lua_isfunction( L, 1 ) ) {
+        lua_pushvalue( L, 1 );
+        lc.luaErrorHandlerRef_ = luaL_ref( L, LUA_REGISTRYINDEX );
+    }
     return 0;
 }
 
+//------------------------------------------------------------------------------
+int LuaContext::CallbackStatsToLua( lua_State* L ) {
+    LuaContext& lc = *reinterpret_cast< LuaContext* >( lua_touserdata( L, lua_upvalueindex( 1 ) ) );
+    lc.dispatcher_.PushStats( L );
+    if( lua_toboolean( L, 1 ) ) lc.dispatcher_.ResetStats();
+    return 1;
+}
+
 //------------------------------------------------------------------------------
 int LuaContext::SetQObjectsOwnership( lua_State* L ) {
     LuaContext& lc = *reinterpret_cast< LuaContext* >( lua_touserdata( L, lua_upvalueindex( 1 ) ) );
@@ -380,377 +715,400 @@ int LuaContext::SetQObjectsOwnership( lua_State* L ) {
     return 0;
 }
 
+//------------------------------------------------------------------------------
+int LuaContext::EnableTypedArrays( lua_State* L ) {
+    SetTypedArraysEnabled( L, lua_toboolean( L, 1 ) != 0 );
+    return 0;
+}
+
 //------------------------------------------------------------------------------
 int LuaContext::InvokeMethod( lua_State *L ) {
     const Methods& m = *( reinterpret_cast< Methods* >( lua_touserdata( L, lua_upvalueindex( 1 ) ) ) );
     LuaContext& lc = *( reinterpret_cast< LuaContext* >( lua_touserdata( L, lua_upvalueindex( 2 ) ) ) );
-    const int numArgs = lua_gettop( L );
-    int idx = -1;
-    const Method* mi = 0;
-    for( Methods::const_iterator i = m.begin(); i != m.end(); ++i ) {
-        if( i->argumentWrappers_.size() == numArgs ) {
-            mi = &( *i );
-            break;
-        }
-    }
-    if( !mi ) throw std::logic_error( "Method not found" );
-    switch( numArgs ) {
-        case  0: return Invoke0( mi, lc );
-                 break;
-        case  1: return Invoke1( mi, lc );
-                 break;
-        case  2: return Invoke2( mi, lc );
-                break;
-        case  3: return Invoke3( mi, lc );
-                break;
-        case  4: return Invoke4( mi, lc );
-                 break;
-        case  5: return Invoke5( mi, lc );
-                 break;
-        case  6: return Invoke6( mi, lc );
-                 break;
-        case  7: return Invoke7( mi, lc );
-                 break;
-        case  8: return Invoke8( mi, lc );
-                 break;
-        case  9: return Invoke8( mi, lc );
-                 break;
-        case 10: return Invoke10( mi, lc );
-                 break;
-        default: throw std::range_error( "Invalid number of arguments" );
-                 break;                                                         
-    }
-    return 0;
+    QObject* obj = reinterpret_cast< QObject* >( lua_touserdata( L, lua_upvalueindex( 3 ) ) );
+    return Invoke( m, L, lc, obj );
 }
 
-//==============================================================================
-
-void HandleReturnValue( LuaContext& lc, QMetaType::Type type ) {
-    if( type == QMetaType::QObjectStar || type == QMetaType::QWidgetStar ) {
-        QObject* obj = reinterpret_cast< QObject* >( lua_touserdata( lc.LuaState(), -1 ) );
-        lua_pop( lc.LuaState(), 1 );
-        lc.AddQObject( obj, 0, lc.OwnQObjects() ? LuaContext::QOBJ_IMMEDIATE_DELETE 
-                               : LuaContext::QOBJ_NO_DELETE );
+//------------------------------------------------------------------------------
+int LuaContext::InvokeProxyMethod( lua_State *L ) {
+    const Methods& m = *( reinterpret_cast< Methods* >( lua_touserdata( L, lua_upvalueindex( 1 ) ) ) );
+    LuaContext& lc = *( reinterpret_cast< LuaContext* >( lua_touserdata( L, lua_upvalueindex( 2 ) ) ) );
+    const ClassInfo& ci = *reinterpret_cast< ClassInfo* >( lua_touserdata( L, lua_upvalueindex( 3 ) ) );
+    QObject* obj = lua_type( L, 1 ) == LUA_TUSERDATA ? ClassInstance( L, 1, ci ) : 0;
+    if( !obj ) {
+        RaiseLuaError( L, "QObject proxy methods must be invoked with the ':' operator" );
+        return 0;
     }
+    // remove 'self' from stack: method arguments start at index 1
+    lua_remove( L, 1 );
+    return Invoke( m, L, lc, obj );
 }
 
-int LuaContext::Invoke0( const Method* mi, LuaContext& lc ) {
-    bool ok = false;
-    lua_State* L = lc.LuaState();
-    if( mi->returnWrapper_.Type().isEmpty() ) {
-        ok = mi->metaMethod_.invoke( mi->obj_, Qt::DirectConnection );
-        if( ok ) return 0;
-    } else {
-        ok = mi->metaMethod_.invoke( mi->obj_, Qt::DirectConnection,
-                                     mi->returnWrapper_.Arg() ); //passes the location (void*) where return data will be stored
-        if( ok ) {
-            mi->returnWrapper_.Push( L );
-            HandleReturnValue( lc, mi->returnWrapper_.MetaType() );
-            return 1;
+//------------------------------------------------------------------------------
+QObject* LuaContext::ClassInstance( lua_State* L, int idx, const ClassInfo& ci ) {
+    if( idx < 0 ) idx = lua_gettop( L ) + idx + 1;
+    // tables reference the QObjectHandle through the 'qobject__' field, read
+    // without invoking the __index method of tables with live properties
+    const bool table = lua_istable( L, idx );
+    if( table ) {
+        lua_pushstring( L, "qobject__" );
+        lua_rawget( L, idx );
+    }
+    const int h = table ? lua_gettop( L ) : idx;
+    QObject* obj = 0;
+    if( lua_type( L, h ) == LUA_TUSERDATA && lua_getmetatable( L, h ) ) {
+        lua_rawgeti( L, LUA_REGISTRYINDEX, ci.metaTableRef_ );
+        if( lua_rawequal( L, -1, -2 ) ) {
+            obj = reinterpret_cast< QObjectHandle* >( lua_touserdata( L, h ) )->obj_;
         }
+        lua_pop( L, 2 );
     }
-    lua_pushstring( L, "Slot invocation error" );
-    lua_error( L );
-    return 0;
+    if( table ) lua_pop( L, 1 );
+    return obj;
 }
-int LuaContext::Invoke1( const Method* mi, LuaContext& lc ) {
-    bool ok = false;
-    lua_State* L = lc.LuaState();
-    if( mi->returnWrapper_.Type().isEmpty() ) {
-        ok = mi->metaMethod_.invoke( mi->obj_, Qt::DirectConnection,
-                                     mi->argumentWrappers_[ 0 ].Arg( L, 1 ) );
-        if( ok ) return 0;
-    } else {
-        ok = mi->metaMethod_.invoke( mi->obj_, Qt::DirectConnection,
-                                     mi->returnWrapper_.Arg(), //passes the location (void*) where return data will be stored
-                                     mi->argumentWrappers_[ 0 ].Arg( L, 1 ) );
-        if( ok ) {
-            mi->returnWrapper_.Push( L );
-            HandleReturnValue( lc, mi->returnWrapper_.MetaType() );
-            return 1;
-        }
+
+//------------------------------------------------------------------------------
+int LuaContext::ProxyIndex( lua_State* L ) {
+    // upvalues: LuaContext, ClassInfo, index table
+    // stack: proxy userdata, key
+    const ClassInfo& ci = *reinterpret_cast< ClassInfo* >( lua_touserdata( L, lua_upvalueindex( 2 ) ) );
+    // 1) function already created: return it; property: read value 
+    lua_pushvalue( L, 2 );
+    lua_rawget( L, lua_upvalueindex( 3 ) );
+    if( lua_isfunction( L, -1 ) ) return 1;
+    if( lua_isnumber( L, -1 ) ) {
+        QObject* obj = ClassInstance( L, 1, ci );
+        if( obj ) PushProperty( L, obj, ci.properties_[ int( lua_tointeger( L, -1 ) ) ] );
+        else lua_pushnil( L );
+        return 1;
     }
-    lua_pushstring( L, "Slot invocation error" );
-    lua_error( L );
-    return 0;
+    lua_pop( L, 1 );
+    if( lua_type( L, 2 ) != LUA_TSTRING ) {
+        lua_pushnil( L );
+        return 1;
+    }
+    LuaContext* lc = reinterpret_cast< LuaContext* >( lua_touserdata( L, lua_upvalueindex( 1 ) ) );
+    size_t len = 0;
+    const char* key = lua_tolstring( L, 2, &len );
+    // 2) method: create function shared among all the instances of the class
+    //    and cache it
+    QMap< QByteArray, Methods >::const_iterator mi = 
+        ci.methods_.find( QByteArray::fromRawData( key, int( len ) ) );
+    if( mi != ci.methods_.end() ) {
+        lua_pushlightuserdata( L, const_cast< Methods* >( &mi.value() ) );
+        lua_pushlightuserdata( L, lc );
+        lua_pushlightuserdata( L, const_cast< ClassInfo* >( &ci ) );
+        lua_pushcclosure( L, LuaContext::InvokeProxyMethod, 3 );
+        lua_pushvalue( L, 2 );
+        lua_pushvalue( L, -2 );
+        lua_rawset( L, lua_upvalueindex( 3 ) );
+        return 1;
+    }
+    lua_pushnil( L );
+    return 1;
 }
-int LuaContext::Invoke2( const Method* mi, LuaContext& lc ) {
-    bool ok = false;
-    lua_State* L = lc.LuaState();
-    if( mi->returnWrapper_.Type().isEmpty() ) {
-        ok = mi->metaMethod_.invoke( mi->obj_, Qt::DirectConnection,
-                                     mi->argumentWrappers_[ 0 ].Arg( L, 1 ),
-                                     mi->argumentWrappers_[ 1 ].Arg( L, 2 ) );
-        if( ok ) return 0;
-    } else {
-        ok = mi->metaMethod_.invoke( mi->obj_, Qt::DirectConnection,
-                                     mi->returnWrapper_.Arg(), //passes the location (void*) where return data will be stored
-                                     mi->argumentWrappers_[ 0 ].Arg( L, 1 ),
-                                     mi->argumentWrappers_[ 1 ].Arg( L, 2 ) );
-        if( ok ) {
-            mi->returnWrapper_.Push( L );
-            HandleReturnValue( lc, mi->returnWrapper_.MetaType() );
-            return 1;
-        }
+
+//------------------------------------------------------------------------------
+int LuaContext::PropertyIndex( lua_State* L ) {
+    // upvalues: ClassInfo, index table
+    // stack: table, key
+    lua_pushvalue( L, 2 );
+    lua_rawget( L, lua_upvalueindex( 2 ) );
+    if( !lua_isnumber( L, -1 ) ) {
+        lua_pushnil( L );
+        return 1;
     }
-    lua_pushstring( L, "Slot invocation error" );
-    lua_error( L );
-    return 0;
+    const ClassInfo& ci = *reinterpret_cast< ClassInfo* >( lua_touserdata( L, lua_upvalueindex( 1 ) ) );
+    QObject* obj = ClassInstance( L, 1, ci );
+    if( obj ) PushProperty( L, obj, ci.properties_[ int( lua_tointeger( L, -1 ) ) ] );
+    else lua_pushnil( L );
+    return 1;
 }
-int LuaContext::Invoke3( const Method* mi, LuaContext& lc ) {
-    bool ok = false;
-    lua_State* L = lc.LuaState();
-    if( mi->returnWrapper_.Type().isEmpty() ) {
-        ok = mi->metaMethod_.invoke( mi->obj_, Qt::DirectConnection,
-                                     mi->argumentWrappers_[ 0 ].Arg( L, 1 ),
-                                     mi->argumentWrappers_[ 1 ].Arg( L, 2 ),
-                                     mi->argumentWrappers_[ 2 ].Arg( L, 3 ) );
-        if( ok ) return 0;
-    } else {
-        ok = mi->metaMethod_.invoke( mi->obj_, Qt::DirectConnection,
-                                     mi->returnWrapper_.Arg(), //passes the location (void*) where return data will be stored
-                                     mi->argumentWrappers_[ 0 ].Arg( L, 1 ),
-                                     mi->argumentWrappers_[ 1 ].Arg( L, 2 ),
-                                     mi->argumentWrappers_[ 2 ].Arg( L, 3 ) );
-        if( ok ) {
-            mi->returnWrapper_.Push( L );
-            HandleReturnValue( lc, mi->returnWrapper_.MetaType() );
-            return 1;
-        }
+
+//------------------------------------------------------------------------------
+int LuaContext::PropertyNewIndex( lua_State* L ) {
+    // upvalues: ClassInfo, index table
+    // stack: table or proxy, key, value
+    lua_pushvalue( L, 2 );
+    lua_rawget( L, lua_upvalueindex( 2 ) );
+    if( !lua_isnumber( L, -1 ) ) {
+        // not a property: tables accept new fields, proxies do not
+        if( lua_istable( L, 1 ) ) {
+            lua_pop( L, 1 );
+            lua_rawset( L, 1 );
+        } else RaiseLuaError( L, "Cannot add fields to QObject proxy" );
+        return 0;
     }
-    lua_pushstring( L, "Slot invocation error" );
-    lua_error( L );
+    const ClassInfo& ci = *reinterpret_cast< ClassInfo* >( lua_touserdata( L, lua_upvalueindex( 1 ) ) );
+    const QMetaProperty& mp = ci.properties_[ int( lua_tointeger( L, -1 ) ) ];
+    lua_pop( L, 1 );
+    QObject* obj = ClassInstance( L, 1, ci );
+    if( !obj ) {
+        RaiseLuaError( L, "Properties can only be written to QObjects of the class" );
+        return 0;
+    }
+    WriteProperty( L, obj, mp, 3 );
     return 0;
 }
-int LuaContext::Invoke4( const Method* mi, LuaContext& lc ) {
-    bool ok = false;
-    lua_State* L = lc.LuaState();
-    if( mi->returnWrapper_.Type().isEmpty() ) {
-        ok = mi->metaMethod_.invoke( mi->obj_, Qt::DirectConnection,
-                                     mi->argumentWrappers_[ 0 ].Arg( L, 1 ),
-                                     mi->argumentWrappers_[ 1 ].Arg( L, 2 ),
-                                     mi->argumentWrappers_[ 2 ].Arg( L, 3 ),
-                                     mi->argumentWrappers_[ 3 ].Arg( L, 4 ) );
-        if( ok ) return 0;
-    } else {
-        ok = mi->metaMethod_.invoke( mi->obj_, Qt::DirectConnection,
-                                     mi->returnWrapper_.Arg(), //passes the location (void*) where return data will be stored
-                                     mi->argumentWrappers_[ 0 ].Arg( L, 1 ),
-                                     mi->argumentWrappers_[ 1 ].Arg( L, 2 ),
-                                     mi->argumentWrappers_[ 2 ].Arg( L, 3 ),
-                                     mi->argumentWrappers_[ 3 ].Arg( L, 4 ) );
-        if( ok ) {
-            mi->returnWrapper_.Push( L );
-            HandleReturnValue( lc, mi->returnWrapper_.MetaType() );
-            return 1;
-        }
+
+//------------------------------------------------------------------------------
+// Primitive types are read through QMetaObject::metacall directly into a
+// local variable, other types are read through QMetaProperty::read
+void LuaContext::PushProperty( lua_State* L, QObject* obj, const QMetaProperty& mp ) {
+    if( !mp.isReadable() ) {
+        lua_pushnil( L );
+        return;
+    }
+    int status = -1;
+    switch( mp.userType() ) {
+        case QMetaType::Bool: {
+                bool v = false;
+                void* argv[] = { &v, 0, &status };
+                QMetaObject::metacall( obj, QMetaObject::ReadProperty, mp.propertyIndex(), argv );
+                lua_pushboolean( L, v );
+            }
+            break;
+        case QMetaType::Int: {
+                int v = 0;
+                void* argv[] = { &v, 0, &status };
+                QMetaObject::metacall( obj, QMetaObject::ReadProperty, mp.propertyIndex(), argv );
+                lua_pushinteger( L, v );
+            }
+            break;
+        case QMetaType::UInt: {
+                uint v = 0;
+                void* argv[] = { &v, 0, &status };
+                QMetaObject::metacall( obj, QMetaObject::ReadProperty, mp.propertyIndex(), argv );
+                lua_pushnumber( L, v );
+            }
+            break;
+        case QMetaType::Double: {
+                double v = 0;
+                void* argv[] = { &v, 0, &status };
+                QMetaObject::metacall( obj, QMetaObject::ReadProperty, mp.propertyIndex(), argv );
+                lua_pushnumber( L, v );
+            }
+            break;
+        case QMetaType::Float: {
+                float v = 0;
+                void* argv[] = { &v, 0, &status };
+                QMetaObject::metacall( obj, QMetaObject::ReadProperty, mp.propertyIndex(), argv );
+                lua_pushnumber( L, v );
+            }
+            break;
+        default: {
+                const int top = lua_gettop( L );
+                VariantToLuaValue( mp.read( obj ), L );
+                if( lua_gettop( L ) == top ) lua_pushnil( L );
+            }
+            break;
     }
-    lua_pushstring( L, "Slot invocation error" );
-    lua_error( L );
-    return 0;
 }
-int LuaContext::Invoke5( const Method* mi, LuaContext& lc ) {
-    bool ok = false;
-    lua_State* L = lc.LuaState();
-    if( mi->returnWrapper_.Type().isEmpty() ) {
-        ok = mi->metaMethod_.invoke( mi->obj_, Qt::DirectConnection,
-                                     mi->argumentWrappers_[ 0 ].Arg( L, 1 ),
-                                     mi->argumentWrappers_[ 1 ].Arg( L, 2 ),
-                                     mi->argumentWrappers_[ 2 ].Arg( L, 3 ),
-                                     mi->argumentWrappers_[ 3 ].Arg( L, 4 ),
-                                     mi->argumentWrappers_[ 4 ].Arg( L, 5 ) );
-        if( ok ) return 0;
-    } else {
-        ok = mi->metaMethod_.invoke( mi->obj_, Qt::DirectConnection,
-                                     mi->returnWrapper_.Arg(), //passes the location (void*) where return data will be stored
-                                     mi->argumentWrappers_[ 0 ].Arg( L, 1 ),
-                                     mi->argumentWrappers_[ 1 ].Arg( L, 2 ),
-                                     mi->argumentWrappers_[ 2 ].Arg( L, 3 ),
-                                     mi->argumentWrappers_[ 3 ].Arg( L, 4 ),
-                                     mi->argumentWrappers_[ 4 ].Arg( L, 5 ) );
-        if( ok ) {
-            mi->returnWrapper_.Push( L );
-            HandleReturnValue( lc, mi->returnWrapper_.MetaType() );
-            return 1;
-        }
+
+//------------------------------------------------------------------------------
+// Primitive types are written through QMetaObject::metacall directly from a
+// local variable, other types are written through QMetaProperty::write
+void LuaContext::WriteProperty( lua_State* L, QObject* obj, const QMetaProperty& mp, int idx ) {
+    if( !mp.isWritable() ) {
+        RaiseLuaError( L, "Property '" + QString( mp.name() ) + "' is read-only" );
+        return;
+    }
+    int status = -1;
+    int flags = 0;
+    switch( mp.userType() ) {
+        case QMetaType::Bool: {
+                bool v = lua_toboolean( L, idx ) != 0;
+                void* argv[] = { &v, 0, &status, &flags };
+                QMetaObject::metacall( obj, QMetaObject::WriteProperty, mp.propertyIndex(), argv );
+            }
+            break;
+        case QMetaType::Int: {
+                int v = int( luaL_checkinteger( L, idx ) );
+                void* argv[] = { &v, 0, &status, &flags };
+                QMetaObject::metacall( obj, QMetaObject::WriteProperty, mp.propertyIndex(), argv );
+            }
+            break;
+        case QMetaType::UInt: {
+                uint v = uint( luaL_checknumber( L, idx ) );
+                void* argv[] = { &v, 0, &status, &flags };
+                QMetaObject::metacall( obj, QMetaObject::WriteProperty, mp.propertyIndex(), argv );
+            }
+            break;
+        case QMetaType::Double: {
+                double v = luaL_checknumber( L, idx );
+                void* argv[] = { &v, 0, &status, &flags };
+                QMetaObject::metacall( obj, QMetaObject::WriteProperty, mp.propertyIndex(), argv );
+            }
+            break;
+        case QMetaType::Float: {
+                float v = float( luaL_checknumber( L, idx ) );
+                void* argv[] = { &v, 0, &status, &flags };
+                QMetaObject::metacall( obj, QMetaObject::WriteProperty, mp.propertyIndex(), argv );
+            }
+            break;
+        default: 
+            if( lua_istable( L, idx ) ) mp.write( obj, ParseLuaTable( L, idx, false ) );
+            else mp.write( obj, LuaValueToQVariant( L, idx ) );
+            break;
     }
-    lua_pushstring( L, "Slot invocation error" );
-    lua_error( L );
-    return 0;
 }
-int LuaContext::Invoke6( const Method* mi, LuaContext& lc ) {
-    bool ok = false;
-    lua_State* L = lc.LuaState();
-    if( mi->returnWrapper_.Type().isEmpty() ) {
-        ok = mi->metaMethod_.invoke( mi->obj_, Qt::DirectConnection,
-                                     mi->argumentWrappers_[ 0 ].Arg( L, 1 ),
-                                     mi->argumentWrappers_[ 1 ].Arg( L, 2 ),
-                                     mi->argumentWrappers_[ 2 ].Arg( L, 3 ),
-                                     mi->argumentWrappers_[ 3 ].Arg( L, 4 ),
-                                     mi->argumentWrappers_[ 4 ].Arg( L, 5 ),
-                                     mi->argumentWrappers_[ 5 ].Arg( L, 6 ) );
-        if( ok ) return 0;
-    } else {
-        ok = mi->metaMethod_.invoke( mi->obj_, Qt::DirectConnection,
-                                     mi->returnWrapper_.Arg(), //passes the location (void*) where return data will be stored
-                                     mi->argumentWrappers_[ 0 ].Arg( L, 1 ),
-                                     mi->argumentWrappers_[ 1 ].Arg( L, 2 ),
-                                     mi->argumentWrappers_[ 2 ].Arg( L, 3 ),
-                                     mi->argumentWrappers_[ 3 ].Arg( L, 4 ),
-                                     mi->argumentWrappers_[ 4 ].Arg( L, 5 ),
-                                     mi->argumentWrappers_[ 5 ].Arg( L, 6 ) );
-        if( ok ) {
-            mi->returnWrapper_.Push( L );
-            HandleReturnValue( lc, mi->returnWrapper_.MetaType() );
-            return 1;
+
+//------------------------------------------------------------------------------
+// QObjects returned from methods are added to the Lua context: the QObject
+// pointer on the top of the Lua stack is replaced with the table or proxy
+// wrapping the object; the calling Lua thread can be different from the
+// context's main thread when methods are invoked from coroutines; null
+// pointers are returned as nil
+void HandleReturnValue( lua_State* L, LuaContext& lc, QMetaType::Type type ) {
+    if( type == QMetaType::QObjectStar || type == QMetaType::QWidgetStar ) {
+        QObject* obj = reinterpret_cast< QObject* >( lua_touserdata( L, -1 ) );
+        lua_pop( L, 1 );
+        if( obj == 0 ) {
+            lua_pushnil( L );
+            return;
         }
+        lc.AddQObject( obj, 0, lc.OwnQObjects() ? LuaContext::QOBJ_IMMEDIATE_DELETE 
+                               : LuaContext::QOBJ_NO_DELETE );
+        if( L != lc.LuaState() ) lua_xmove( lc.LuaState(), L, 1 );
     }
-    lua_pushstring( L, "Slot invocation error" );
-    lua_error( L );
-    return 0;
 }
-int LuaContext::Invoke7( const Method* mi, LuaContext& lc ) {
-    bool ok = false;
-    lua_State* L = lc.LuaState();
-    if( mi->returnWrapper_.Type().isEmpty() ) {
-        ok = mi->metaMethod_.invoke( mi->obj_, Qt::DirectConnection,
-                                     mi->argumentWrappers_[ 0 ].Arg( L, 1 ),
-                                     mi->argumentWrappers_[ 1 ].Arg( L, 2 ),
-                                     mi->argumentWrappers_[ 2 ].Arg( L, 3 ),
-                                     mi->argumentWrappers_[ 3 ].Arg( L, 4 ),
-                                     mi->argumentWrappers_[ 4 ].Arg( L, 5 ),
-                                     mi->argumentWrappers_[ 5 ].Arg( L, 6 ),
-                                     mi->argumentWrappers_[ 6 ].Arg( L, 7 ) );
-        if( ok ) return 0;
-    } else {
-        ok = mi->metaMethod_.invoke( mi->obj_, Qt::DirectConnection,
-                                     mi->returnWrapper_.Arg(), //passes the location (void*) where return data will be stored
-                                     mi->argumentWrappers_[ 0 ].Arg( L, 1 ),
-                                     mi->argumentWrappers_[ 1 ].Arg( L, 2 ),
-                                     mi->argumentWrappers_[ 2 ].Arg( L, 3 ),
-                                     mi->argumentWrappers_[ 3 ].Arg( L, 4 ),
-                                     mi->argumentWrappers_[ 4 ].Arg( L, 5 ),
-                                     mi->argumentWrappers_[ 5 ].Arg( L, 6 ),
-                                     mi->argumentWrappers_[ 6 ].Arg( L, 7 ) );
-        if( ok ) {
-            mi->returnWrapper_.Push( L );
-            HandleReturnValue( lc, mi->returnWrapper_.MetaType() );
-            return 1;
+
+//------------------------------------------------------------------------------
+// Each overload with the right number of parameters is scored by matching the
+// type of each Lua argument against the parameter types and the one with the
+// highest score is selected; if no overload can accept the arguments the first
+// one is returned and conversion errors are reported when checking arguments.
+// The score only depends on the Lua types: the selected overload is cached by
+// the packed type signature of the arguments
+const LuaContext::Method* LuaContext::SelectOverload( const Methods& m, lua_State* L, int numArgs ) {
+    if( m.overloads_.size() == 1 ) {
+        const Method& mi = m.overloads_.front();
+        return mi.argumentWrappers_.size() == numArgs ? &mi : 0;
+    }
+    const bool cacheable = numArgs <= Methods::MAX_CACHED_ARGS;
+    quint64 signature = 0;
+    if( cacheable ) {
+        signature = quint64( numArgs );
+        for( int a = 1; a <= numArgs; ++a ) {
+            signature |= quint64( lua_type( L, a ) + 1 ) << ( 4 * a );
+        }
+        if( m.lastMethod_ && signature == m.lastSignature_ ) return m.lastMethod_;
+        QHash< quint64, const Method* >::const_iterator c = m.cache_.find( signature );
+        if( c != m.cache_.end() ) {
+            m.lastSignature_ = signature;
+            m.lastMethod_ = c.value();
+            return m.lastMethod_;
         }
     }
-    lua_pushstring( L, "Slot invocation error" );
-    lua_error( L );
-    return 0;
-}
-int LuaContext::Invoke8( const Method* mi, LuaContext& lc ) {
-    bool ok = false;
-    lua_State* L = lc.LuaState();
-    if( mi->returnWrapper_.Type().isEmpty() ) {
-        ok = mi->metaMethod_.invoke( mi->obj_, Qt::DirectConnection,
-                                     mi->argumentWrappers_[ 0 ].Arg( L, 1 ),
-                                     mi->argumentWrappers_[ 1 ].Arg( L, 2 ),
-                                     mi->argumentWrappers_[ 2 ].Arg( L, 3 ),
-                                     mi->argumentWrappers_[ 3 ].Arg( L, 4 ),
-                                     mi->argumentWrappers_[ 4 ].Arg( L, 5 ),
-                                     mi->argumentWrappers_[ 5 ].Arg( L, 6 ),
-                                     mi->argumentWrappers_[ 6 ].Arg( L, 7 ),
-                                     mi->argumentWrappers_[ 7 ].Arg( L, 8 ) );
-        if( ok ) return 0;
-    } else {
-        ok = mi->metaMethod_.invoke( mi->obj_, Qt::DirectConnection,
-                                     mi->returnWrapper_.Arg(), //passes the location (void*) where return data will be stored
-                                     mi->argumentWrappers_[ 0 ].Arg( L, 1 ),
-                                     mi->argumentWrappers_[ 1 ].Arg( L, 2 ),
-                                     mi->argumentWrappers_[ 2 ].Arg( L, 3 ),
-                                     mi->argumentWrappers_[ 3 ].Arg( L, 4 ),
-                                     mi->argumentWrappers_[ 4 ].Arg( L, 5 ),
-                                     mi->argumentWrappers_[ 5 ].Arg( L, 6 ),
-                                     mi->argumentWrappers_[ 6 ].Arg( L, 7 ),
-                                     mi->argumentWrappers_[ 7 ].Arg( L, 8 ) );
-        if( ok ) {
-            mi->returnWrapper_.Push( L );
-            HandleReturnValue( lc, mi->returnWrapper_.MetaType() );
-            return 1;
+    const Method* first = 0;
+    const Method* best = 0;
+    int bestScore = 0;
+    for( QList< Method >::const_iterator i = m.overloads_.begin(); i != m.overloads_.end(); ++i ) {
+        if( i->argumentWrappers_.size() != numArgs ) continue;
+        if( !first ) first = &( *i );
+        int score = 1;
+        for( int a = 0; a != numArgs; ++a ) {
+            const int s = i->argumentWrappers_[ a ].Score( lua_type( L, a + 1 ) );
+            if( s == 0 ) {
+                score = 0;
+                break;
+            }
+            score += s;
+        }
+        if( score > bestScore ) {
+            best = &( *i );
+            bestScore = score;
         }
     }
-    lua_pushstring( L, "Slot invocation error" );
-    lua_error( L );
-    return 0;
+    if( !best ) best = first;
+    if( best && cacheable ) {
+        m.cache_.insert( signature, best );
+        m.lastSignature_ = signature;
+        m.lastMethod_ = best;
+    }
+    return best;
 }
-int LuaContext::Invoke9( const Method* mi, LuaContext& lc ) {
-    bool ok = false;
-    lua_State* L = lc.LuaState();
-    if( mi->returnWrapper_.Type().isEmpty() ) {
-        ok = mi->metaMethod_.invoke( mi->obj_, Qt::DirectConnection,
-                                     mi->argumentWrappers_[ 0 ].Arg( L, 1 ),
-                                     mi->argumentWrappers_[ 1 ].Arg( L, 2 ),
-                                     mi->argumentWrappers_[ 2 ].Arg( L, 3 ),
-                                     mi->argumentWrappers_[ 3 ].Arg( L, 4 ),
-                                     mi->argumentWrappers_[ 4 ].Arg( L, 5 ),
-                                     mi->argumentWrappers_[ 5 ].Arg( L, 6 ),
-                                     mi->argumentWrappers_[ 6 ].Arg( L, 7 ),
-                                     mi->argumentWrappers_[ 7 ].Arg( L, 8 ),
-                                     mi->argumentWrappers_[ 8 ].Arg( L, 9 ) );
-        if( ok ) return 0;
-    } else {
-        ok = mi->metaMethod_.invoke( mi->obj_, Qt::DirectConnection,
-                                     mi->returnWrapper_.Arg(), //passes the location (void*) where return data will be stored
-                                     mi->argumentWrappers_[ 0 ].Arg( L, 1 ),
-                                     mi->argumentWrappers_[ 1 ].Arg( L, 2 ),
-                                     mi->argumentWrappers_[ 2 ].Arg( L, 3 ),
-                                     mi->argumentWrappers_[ 3 ].Arg( L, 4 ),
-                                     mi->argumentWrappers_[ 4 ].Arg( L, 5 ),
-                                     mi->argumentWrappers_[ 5 ].Arg( L, 6 ),
-                                     mi->argumentWrappers_[ 6 ].Arg( L, 7 ),
-                                     mi->argumentWrappers_[ 7 ].Arg( L, 8 ),
-                                     mi->argumentWrappers_[ 8 ].Arg( L, 9 ) );
-        if( ok ) {
-            mi->returnWrapper_.Push( L );
-            HandleReturnValue( lc, mi->returnWrapper_.MetaType() );
-            return 1;
+
+//------------------------------------------------------------------------------
+int LuaContext::Invoke( const Methods& m, lua_State* L, LuaContext& lc, QObject* obj ) {
+    const int numArgs = lua_gettop( L );
+    const Method* mi = SelectOverload( m, L, numArgs );
+    if( !mi ) {
+        RaiseLuaError( L, "No method accepting " + QString::number( numArgs ) + " arguments" );
+        return 0;
+    }
+    if( !mi->returnWrapper_.IsValid() ) {
+        RaiseLuaError( L, "Type " + QString( mi->returnWrapper_.Type() ) + " unknown" );
+        return 0;
+    }
+    for( int a = 0; a != numArgs; ++a ) {
+        if( !mi->argumentWrappers_[ a ].IsValid() ) {
+            RaiseLuaError( L, "Type " + QString( mi->argumentWrappers_[ a ].Type() ) + " unknown" );
+            return 0;
         }
     }
-    lua_pushstring( L, "Slot invocation error" );
-    lua_error( L );
-    return 0;
-}
-int LuaContext::Invoke10( const Method* mi, LuaContext& lc ) {
+    // lua_error does not unwind the C++ stack: all the Lua values are checked
+    // before any C++ value is created
+    for( int a = 0; a != numArgs; ++a ) mi->argumentWrappers_[ a ].Check( L, a + 1 );
+    const bool hasReturn = !mi->returnWrapper_.Type().isEmpty();
     bool ok = false;
-    lua_State* L = lc.LuaState();
-    if( mi->returnWrapper_.Type().isEmpty() ) {
-        ok = mi->metaMethod_.invoke( mi->obj_, Qt::DirectConnection,
-                                     mi->argumentWrappers_[ 0 ].Arg( L,  1 ),
-                                     mi->argumentWrappers_[ 1 ].Arg( L,  2 ),
-                                     mi->argumentWrappers_[ 2 ].Arg( L,  3 ),
-                                     mi->argumentWrappers_[ 3 ].Arg( L,  4 ),
-                                     mi->argumentWrappers_[ 4 ].Arg( L,  5 ),
-                                     mi->argumentWrappers_[ 5 ].Arg( L,  6 ),
-                                     mi->argumentWrappers_[ 6 ].Arg( L,  7 ),
-                                     mi->argumentWrappers_[ 7 ].Arg( L,  8 ),
-                                     mi->argumentWrappers_[ 8 ].Arg( L,  9 ),
-                                     mi->argumentWrappers_[ 9 ].Arg( L, 10 ) );
-        if( ok ) return 0;
-    } else {
-        ok = mi->metaMethod_.invoke( mi->obj_, Qt::DirectConnection,
-                                     mi->returnWrapper_.Arg(), //passes the location (void*) where return data will be stored
-                                     mi->argumentWrappers_[ 0 ].Arg( L,  1 ),
-                                     mi->argumentWrappers_[ 1 ].Arg( L,  2 ),
-                                     mi->argumentWrappers_[ 2 ].Arg( L,  3 ),
-                                     mi->argumentWrappers_[ 3 ].Arg( L,  4 ),
-                                     mi->argumentWrappers_[ 4 ].Arg( L,  5 ),
-                                     mi->argumentWrappers_[ 5 ].Arg( L,  6 ),
-                                     mi->argumentWrappers_[ 6 ].Arg( L,  7 ),
-                                     mi->argumentWrappers_[ 7 ].Arg( L,  8 ),
-                                     mi->argumentWrappers_[ 8 ].Arg( L,  9 ),
-                                     mi->argumentWrappers_[ 9 ].Arg( L, 10 ) );
-        if( ok ) {
-            mi->returnWrapper_.Push( L );
-            HandleReturnValue( lc, mi->returnWrapper_.MetaType() );
-            return 1;
+    // number of created arguments: creation stops at the first argument whose
+    // content cannot be converted
+    int created = 0;
+    {
+        ArgStorage storage( mi->storageSize_ );
+        // argv[ 0 ] is the location where the return value is stored,
+        // argv[ 1 ] ... argv[ numArgs ] the locations of the arguments
+        QVarLengthArray< void*, 11 > argv( numArgs + 1 );
+        argv[ 0 ] = hasReturn ? mi->returnWrapper_.Arg( storage.At( 0 ) ).data() : 0;
+        for( ; created != numArgs; ++created ) {
+            void* arg = mi->argumentWrappers_[ created ].Arg( L, created + 1,
+                            storage.At( mi->argOffsets_[ created ] ) ).data();
+            if( !arg ) break;
+            argv[ created + 1 ] = arg;
+        }
+        // the method is not invoked if an argument could not be created;
+        // QMetaMethod::invoke accepts at most ten arguments: methods with
+        // more arguments are always invoked through QMetaObject::metacall
+        if( created != numArgs ) ok = false;
+        else if( lc.directInvocation_ || numArgs > 10 ) {
+            // argument types match the signature by construction: skip the
+            // checks performed by QMetaMethod::invoke and call qt_metacall
+            ok = QMetaObject::metacall( obj, QMetaObject::InvokeMetaMethod,
+                                        mi->methodIndex_, argv.data() ) < 0;
+        } else {
+            QGenericArgument args[ 10 ];
+            for( int a = 0; a != numArgs; ++a ) {
+                args[ a ] = QGenericArgument( mi->argumentWrappers_[ a ].Type().constData(),
+                                              argv[ a + 1 ] );
+            }
+            QGenericReturnArgument ret = hasReturn ? 
+                QGenericReturnArgument( mi->returnWrapper_.Type().constData(), argv[ 0 ] )
+                : QGenericReturnArgument();
+            ok = mi->metaMethod_.invoke( obj, Qt::DirectConnection, ret,
+                                         args[ 0 ], args[ 1 ], args[ 2 ], args[ 3 ], args[ 4 ],
+                                         args[ 5 ], args[ 6 ], args[ 7 ], args[ 8 ], args[ 9 ] );
+        }
+        if( ok && hasReturn ) mi->returnWrapper_.Push( L, argv[ 0 ] );
+        if( hasReturn ) mi->returnWrapper_.Destroy( argv[ 0 ] );
+        for( int a = 0; a != created; ++a ) {
+            mi->argumentWrappers_[ a ].Destroy( argv[ a + 1 ] );
         }
     }
-    lua_pushstring( L, "Slot invocation error" );
-    lua_error( L );
-    return 0;
+    // errors are raised once the C++ values and storage are released
+    if( created != numArgs ) {
+        lua_pushfstring( L, "Cannot convert argument %d to %s", created + 1,
+                         mi->argumentWrappers_[ created ].Type().constData() );
+        lua_error( L );
+        return 0;
+    }
+    if( !ok ) {
+        lua_pushstring( L, "Slot invocation error" );
+        lua_error( L );
+        return 0;
+    }
+    if( !hasReturn ) return 0;
+    HandleReturnValue( L, lc, mi->returnWrapper_.MetaType() );
+    return 1;
 }
 }
@@ -39,8 +39,12 @@ extern "C" {
 #include <QMetaMethod>
 #include <QString>
 #include <QMap>
+#include <QHash>
 #include <QList>
 #include <QStringList>
+#include <QPair>
+#include <QVector>
+#include <QMetaProperty>
 
 #include "LuaCallbackDispatcher.h"
 #include "LuaArguments.h"
@@ -74,6 +78,8 @@ struct LuaDefaultSignatureMapper : ILuaSignatureMapper {
         name.truncate( sig.indexOf( "(" ) );
         return name;
     }
+    /// All the instances map signatures in the same way
+    QString cacheKey() const { return "qlua::LuaDefaultSignatureMapper"; }
 };
 
 
@@ -92,13 +98,89 @@ class LuaContext {
     /// for each callable method (i.e. slot or Q_INVOKABLE) storing the signature
     /// to be used at invocation time and the QMetaMethod to use for the actual
     /// invocation.
+    /// Method information does not reference any QObject instance and is
+    /// therefore shared by all the instances of the same class, the QObject
+    /// to invoke the method on is passed to the invocation functions.
+    /// Arguments and return value are created at invocation time in a per-call
+    /// ArgStorage instance: the return value is stored at offset zero and
+    /// arguments at the offsets stored in @c argOffsets_; @c methodIndex_ is the
+    /// absolute method index used for direct invocation through
+    /// @c QMetaObject::metacall.
     struct Method {
-        QObject* obj_;
         QMetaMethod metaMethod_;
         QArgWrappers argumentWrappers_;
         LArgWrapper returnWrapper_;
-        Method( QObject* obj, const QMetaMethod& mm, const QArgWrappers& pw, const LArgWrapper& rw ) :
-        obj_( obj ), metaMethod_( mm ), argumentWrappers_( pw ), returnWrapper_( rw ) {}
+        QVector< size_t > argOffsets_;
+        size_t storageSize_;
+        int methodIndex_;
+        Method( const QMetaMethod& mm, const QArgWrappers& pw, const LArgWrapper& rw ) :
+        metaMethod_( mm ), argumentWrappers_( pw ), returnWrapper_( rw ),
+        storageSize_( AlignArgSize( rw.Size() ) ), methodIndex_( mm.methodIndex() ) {
+            for( QArgWrappers::const_iterator i = pw.begin(); i != pw.end(); ++i ) {
+                argOffsets_.push_back( storageSize_ );
+                storageSize_ += AlignArgSize( i->Size() );
+            }
+        }
+    };
+    /// @brief Overloads of a method sharing the same Lua name.
+    ///
+    /// The overload selected for a specific list of Lua argument types is
+    /// cached: the types are packed into a single integer, four bits per
+    /// argument, and used as the key of a lookup table; the last selected
+    /// overload is also stored to resolve repeated calls with a single integer
+    /// comparison.
+    struct Methods {
+        /// Maximum number of arguments for which the selected overload is cached.
+        enum { MAX_CACHED_ARGS = 15 };
+        QList< Method > overloads_;
+        mutable quint64 lastSignature_;
+        mutable const Method* lastMethod_;
+        mutable QHash< quint64, const Method* > cache_;
+        Methods() : lastSignature_( 0 ), lastMethod_( 0 ) {}
+    };
+    /// @brief Signal resolved from the signature passed to @c qlua.connect,
+    /// @c qlua.disconnect and @c qlua.wait.
+    ///
+    /// Signals are cached per QMetaObject and keyed by the address of the Lua
+    /// signature string: since Lua strings are interned repeated calls with
+    /// the same string only require a hash lookup and a string comparison,
+    /// which verifies that the address was not reused by a different string.
+    /// The parameter wrappers are shared by all the connections to the signal.
+    struct SignalInfo {
+        /// Signature as passed from Lua
+        QByteArray signature_;
+        /// Normalized signature
+        QByteArray normalized_;
+        /// Signal index, negative if not found
+        int index_;
+        /// Parameter wrappers
+        CBackParameterTypes types_;
+        /// First unsupported parameter type, empty if all types are supported
+        QByteArray unknownType_;
+        SignalInfo() : index_( -1 ) {}
+    };
+    /// Method index resolved from the target signature passed to @c qlua.connect
+    /// and @c qlua.disconnect; the signature is stored to verify cache hits
+    typedef QPair< QByteArray, int > MethodIndexInfo;
+    typedef QPair< const QMetaObject*, const char* > SignatureKey;
+    /// Maximum number of cached signatures: caches are cleared when full
+    enum { MAX_CACHED_SIGNATURES = 4096 };
+    /// @brief Per-class method database.
+    ///
+    /// Created the first time an instance of a class is added with a specific
+    /// mapper and filter configuration and shared by all the following instances
+    /// added with the same configuration.
+    struct ClassInfo {
+        /// Lua function name -> overloaded methods
+        QMap< QByteArray, Methods > methods_;
+        /// Properties, indexed through the per-class index table which maps
+        /// property names to positions in this array
+        QVector< QMetaProperty > properties_;
+        /// Reference to metatable shared by all the 'qobject__' userdata and proxy instances
+        int metaTableRef_;
+        /// Reference to metatable shared by all the tables with live properties
+        int tableMetaTableRef_;
+        ClassInfo() : metaTableRef_( LUA_NOREF ), tableMetaTableRef_( LUA_NOREF ) {}
     };
 public:
     /// Delete mode: Specify how/if object shall be garbage collected
@@ -107,8 +189,12 @@ public:
         QOBJ_IMMEDIATE_DELETE, ///< Garbage collected: @e delete used
         QOBJ_DELETE_LATER ///< Garbage collected: @e QObject::deleteLater() used
     };
-    typedef QList< Method > Methods;
-    typedef QMap< QObject*, QMap< QString, Methods > > ObjectMethodMap;
+    /// Wrap mode: Specify how QObjects are exposed to Lua
+    enum ObjectWrapMode {
+        QOBJ_WRAP_TABLE, ///< Lua table with one function per method, invoked as @c obj.method()
+        QOBJ_WRAP_PROXY  ///< Userdata with methods resolved on first access, invoked as @c obj:method()
+    };
+    typedef QMap< QPair< const QMetaObject*, QString >, ClassInfo* > ClassInfoMap;
     typedef QMap< QObject*, int > ObjectReferenceMap;
     /// Constructor: Create @c qlua table with QLua interface.
     /// @param L if not null the passed Lua state is used, otherwise a new one is created.
@@ -147,12 +233,15 @@ public:
         NumberListToLuaTable< T >( l, L_ );
         if( name ) lua_setglobal( L_, name );
     }
-    /// @brief Add QObject to Lua context as a Lua table.
+    /// @brief Add QObject to Lua context as a Lua table or proxy userdata.
     ///
     /// When a new QObject is added this method:
-    ///   -# adds a new QObject reference in the QObject-Method database
-    ///   -# iterates over the callable QObject's methods and for each method
+    ///   -# retrieves the class information matching the object's QMetaObject and
+    ///      the mapper/filter configuration from the class database; if not found
+    ///      it iterates over the callable QObject's methods and for each method
     ///      adds a Method object with information required to invoke the QObject method
+    ///   -# in table mode adds a Lua function per method name bound to the QObject
+    ///      instance; in proxy mode creates a userdata sharing the class metatable
     ///   -# if caching is enabled it creates a Lua reference and adds the reference
     ///      into the QObject-Reference database
     /// @param obj QObject
@@ -173,50 +262,193 @@ public:
                      const QStringList& methodNames = QStringList(),
                      const QList< QMetaMethod::MethodType >& methodTypes =
                            QList< QMetaMethod::MethodType >()  );
+    /// @brief Push Lua wrapper of QObject on the Lua stack.
+    ///
+    /// Wrappers are looked up in an identity cache keyed by QObject address and
+    /// created through AddQObject only when not found: pushing the same
+    /// QObject multiple times pushes the same Lua table or proxy. Cached
+    /// wrappers are weak values, garbage collected when not referenced from
+    /// Lua, and are removed when the QObject emits @c destroyed.
+    /// Used to push QObject pointers received from signals.
+    /// @param obj QObject; nil is pushed if null
+    void PushQObject( QObject* obj );
+    /// @brief Set the way QObjects are exposed to Lua.
+    ///
+    /// In @c QOBJ_WRAP_TABLE mode (default) a new table is created for each QObject
+    /// and a Lua function bound to the object is added for each method.
+    /// In @c QOBJ_WRAP_PROXY mode a single userdata is created for each QObject;
+    /// all the instances of a class share a metatable whose @c __index method
+    /// resolves methods and properties when first accessed and caches the
+    /// created Lua functions. Since functions are shared among instances
+    /// methods must be invoked with the @c ':' operator.
+    /// The selected mode also applies to QObjects returned by methods or
+    /// received from signals.
+    void SetObjectWrapMode( ObjectWrapMode wm ) { wrapMode_ = wm; }
+    /// Return current wrap mode.
+    ObjectWrapMode GetObjectWrapMode() const { return wrapMode_; }
+    /// @brief Enable/disable live properties for QObjects wrapped as tables.
+    ///
+    /// When enabled, property values are not copied into the table; instead
+    /// they are read from and written to the QObject each time they are accessed
+    /// from Lua through @c __index and @c __newindex methods shared by all
+    /// the tables wrapping instances of the same class. Properties of proxies
+    /// are always live.
+    void SetLiveProperties( bool on ) { liveProperties_ = on; }
+    /// Return @c true if live properties are enabled.
+    bool LiveProperties() const { return liveProperties_; }
+    /// @brief Enable/disable direct method invocation.
+    ///
+    /// When enabled (default) methods are invoked through
+    /// @c QMetaObject::metacall passing the per-call argument array directly;
+    /// when disabled @c QMetaMethod::invoke is used, which also validates
+    /// argument types at each invocation.
+    void SetDirectInvocation( bool on ) { directInvocation_ = on; }
+    /// Return @c true if direct method invocation is enabled.
+    bool DirectInvocation() const { return directInvocation_; }
+    /// @brief Enable/disable interned keys.
+    ///
+    /// When enabled the names of properties and methods added to the tables
+    /// wrapping QObjects and the keys of QVariantMaps converted to Lua tables
+    /// are pushed from a per-context cache of Lua strings instead of being
+    /// converted and hashed by Lua each time. Maps with the same keys as the
+    /// previous map in the same QVariantList do not look up keys in the cache.
+    /// Disabling interned keys releases the cached strings.
+    void SetInternKeys( bool on ) {
+        internKeys_ = on;
+        SetKeyCache( L_, on ? &keyCache_ : 0 );
+        if( !on ) keyCache_.Clear( L_ );
+    }
+    /// Return @c true if interned keys are enabled.
+    bool InternKeys() const { return internKeys_; }
+    /// @brief Enable/disable typed arrays.
+    ///
+    /// When enabled QVector<T> values returned from methods or received from
+    /// signals are pushed on the Lua stack as typed arrays: userdata sharing
+    /// the vector data, whose elements are accessed with the @c [] operator and
+    /// whose size is returned by the @c # operator. Typed arrays passed to
+    /// methods accepting a QVector<T> are not copied either.
+    /// Typed arrays can also be enabled from Lua through @c qlua.typedArrays().
+    void SetTypedArrays( bool on ) { SetTypedArraysEnabled( L_, on ); }
+    /// Return @c true if typed arrays are enabled.
+    bool TypedArrays() const { return TypedArraysEnabled( L_ ); }
     /// @brief Return value of global garbage collection policy.
     /// 
     /// The global object ownership policy is set from Lua through a call to
     /// @c qlua.ownQObjects(). The ownership policy affects the QObjects returned
     /// by QObject methods only.
     bool OwnQObjects() const { return ownQObjects_; }
-    /// Destructor: Destroys Lua state if owned by this object
+    /// Function called with the error message, including a traceback, when a
+    /// Lua function connected to a signal raises an error
+    typedef void ( *CallbackErrorHandler )( const QString& error );
+    /// @brief Set handler of errors raised by Lua functions connected to signals.
+    ///
+    /// Errors are always removed from the Lua stack; if no handler is set they are
+    /// discarded. A Lua handler set through @c qlua.onCallbackError() takes
+    /// precedence over the handler set through this method.
+    void SetCallbackErrorHandler( CallbackErrorHandler h ) { errorHandler_ = h; }
+    /// @brief Return statistics of the Lua functions connected to signals.
+    ///
+    /// Statistics are also available from Lua through @c qlua.callbackStats().
+    QList< CallbackStats > CallbackStatistics() const { return dispatcher_.Stats(); }
+    /// Reset statistics of the Lua functions connected to signals.
+    void ResetCallbackStatistics() { dispatcher_.ResetStats(); }
+    /// Destructor: Destroys Lua state if owned by this object and clears class database
     ~LuaContext() {
+        // objects deleted when the Lua state is closed must not access
+        // the wrapper cache
+        dispatcher_.SetLuaContext( 0 );
         if( !wrappedContext_ ) lua_close( L_ );
+        else {
+            SetKeyCache( L_, 0 );
+            keyCache_.Clear( L_ );
+        }
+        for( ClassInfoMap::iterator i = classInfo_.begin(); i != classInfo_.end(); ++i ) {
+            delete *i;
+        }
     }
 private:
+    friend class LuaCallbackDispatcher;
+    friend class LuaCBackMethod;
     /// Remove object from databases.
     void RemoveObject( QObject* obj );
+    /// Remove wrapper of destroyed QObject from identity cache.
+    void QObjectDestroyed( QObject* obj );
+    /// Pass error raised by Lua function connected to signal to error handler.
+    void ReportCallbackError( lua_State* L, const char* error );
+    /// @brief Return cached signal information, resolve signal if not found.
+    ///
+    /// Information is returned by value: the cache is cleared when full.
+    /// @param mo QMetaObject
+    /// @param signal signal signature as returned by @c lua_tostring
+    SignalInfo ResolveSignal( const QMetaObject* mo, const char* signal );
+    /// Return cached index of method, resolve method if not found;
+    /// a negative value is returned if method not found.
+    int ResolveMethod( const QMetaObject* mo, const char* method );
+    /// @brief Return class information matching QMetaObject and configuration,
+    /// create new entry if not found.
+    const ClassInfo& GetClassInfo( const QMetaObject* mo,
+                                   const ILuaSignatureMapper& mapper,
+                                   const QStringList& methodNames,
+                                   const QList< QMetaMethod::MethodType >& methodTypes );
     /// @name Lua interface
     //@{
     /// Connect Qt signal to Lua function or QObject method
     static int QtConnect( lua_State* L );
     /// Disconnect Qt signal from Lua function or QObject method
     static int QtDisconnect( lua_State* L );
+    /// Suspend running coroutine until Qt signal is emitted; signal arguments
+    /// are returned when the coroutine is resumed
+    static int QtWait( lua_State* L );
+    /// Release waiter of running coroutine if resumed from Lua and return
+    /// the arguments: called with the values returned by @c QtWait
+    static int QtWaitReturn( lua_State* L );
+    /// Set Lua function called with errors raised by Lua functions connected
+    /// to signals; nil removes the handler
+    static int SetLuaCallbackErrorHandler( lua_State* L );
+    /// Return array of tables with statistics of Lua functions connected
+    /// to signals; with a single @c true argument statistics are reset
+    static int CallbackStatsToLua( lua_State* L );
     /// Invoke QObject method, this is the function that is called
     /// by each Lua function added to the QObject table: information
     /// on QObject instance and method to call are extracted from 
     /// closure environment as upvalues
     static int InvokeMethod( lua_State* L );
-    /// Invoked automatically by Lua when value is garbage collected 
+    /// Invoke QObject method on proxy object: the QObject is read from
+    /// the first argument, the method list and class information are stored
+    /// in the closure environment
+    static int InvokeProxyMethod( lua_State* L );
+    /// @brief Return QObject referenced by the proxy or table at index @c idx
+    /// if created for the class, NULL otherwise.
+    ///
+    /// Functions and metamethods shared by the instances of a class can be
+    /// called from Lua with any value: the value is accepted only if its
+    /// QObjectHandle has the class metatable.
+    static QObject* ClassInstance( lua_State* L, int idx, const ClassInfo& ci );
+    /// @c __index method of QObject proxies: resolve methods and properties
+    static int ProxyIndex( lua_State* L );
+    /// @c __index method of tables with live properties: read properties
+    static int PropertyIndex( lua_State* L );
+    /// @c __newindex method of QObject proxies and tables: write properties
+    static int PropertyNewIndex( lua_State* L );
+    /// Invoked automatically by Lua when value is garbage collected;
+    /// QObject and delete mode are read from the QObjectHandle userdata
     static int DeleteObject( lua_State* L );
     /// Set default policy for ownership of returned QObjects
     static int SetQObjectsOwnership( lua_State* L );
+    /// Enable/disable typed arrays from Lua
+    static int EnableTypedArrays( lua_State* L );
     //@}
-    //@{
-    /// Called by Invoke depending on the number of arguments in
-    /// method signature.
-    static int Invoke0( const Method* mi, LuaContext& L );
-    static int Invoke1( const Method* mi, LuaContext& L );
-    static int Invoke2( const Method* mi, LuaContext& L );
-    static int Invoke3( const Method* mi, LuaContext& L );
-    static int Invoke4( const Method* mi, LuaContext& L );
-    static int Invoke5( const Method* mi, LuaContext& L );
-    static int Invoke6( const Method* mi, LuaContext& L );
-    static int Invoke7( const Method* mi, LuaContext& L );
-    static int Invoke8( const Method* mi, LuaContext& L );
-    static int Invoke9( const Method* mi, LuaContext& L );
-    static int Invoke10( const Method* mi, LuaContext& L );
-    //@}
+    /// Push property value on Lua stack; primitive types bypass QVariant
+    static void PushProperty( lua_State* L, QObject* obj, const QMetaProperty& mp );
+    /// Write value at position @c idx in Lua stack to property
+    static void WriteProperty( lua_State* L, QObject* obj, const QMetaProperty& mp, int idx );
+    /// Select overloaded method, create arguments from Lua values in per-call
+    /// storage and invoke method with any number of arguments; arguments start
+    /// at index 1 in the stack of the calling Lua thread @c L
+    static int Invoke( const Methods& m, lua_State* L, LuaContext& lc, QObject* obj );
+    /// Select the overload best matching the types of the arguments on the
+    /// Lua stack; returns NULL if no method accepts the number of arguments
+    static const Method* SelectOverload( const Methods& m, lua_State* L, int numArgs );
     /// Push error message on Lua stack and trigger a Lua error.
     void ReportErrors( int status ) {
         if( status != 0 ) {
@@ -227,6 +459,16 @@ private:
     }
     /// Register supported types.
     static void RegisterTypes();
+    /// @brief Userdata stored into the 'qobject__' field of Lua tables.
+    ///
+    /// The QObject pointer must be the first data member: code accessing the
+    /// 'qobject__' field reads the userdata as a pointer to pointer to QObject.
+    /// The metatable of these userdata has a 'qobject__' field set to true,
+    /// which identifies them among other userdata.
+    struct QObjectHandle {
+        QObject* obj_;
+        ObjectDeleteMode deleteMode_;
+    };
 private:
     /// (possibly wrapped) Lua state
     lua_State* L_;
@@ -234,11 +476,33 @@ private:
     bool wrappedContext_;   
     /// State variable affecting the life-time management of returned QObjects
     bool ownQObjects_;
-    /// @brief QObject-Method database: Each QObject is stored together with the list
-    /// of associated method signatures
-    ObjectMethodMap objMethods_;
+    /// How QObjects are exposed to Lua
+    ObjectWrapMode wrapMode_;
+    /// Signal if properties of QObjects wrapped as tables are live
+    bool liveProperties_;
+    /// Signal if methods are invoked through QMetaObject::metacall
+    bool directInvocation_;
+    /// Signal if property and method names are pushed from the key cache
+    bool internKeys_;
+    /// Lua strings used as keys of QObject wrappers and converted maps
+    LuaKeyCache keyCache_;
+    /// @brief Class-Method database: Method information is stored once per
+    /// (QMetaObject, configuration) pair and shared among QObject instances
+    ClassInfoMap classInfo_;
     /// QObject-Lua reference database  
     ObjectReferenceMap objRefs_;
+    /// Reference to weak-valued table mapping QObject addresses to wrappers
+    int wrapperCacheRef_;
+    /// C++ callback error handler
+    CallbackErrorHandler errorHandler_;
+    /// Reference to Lua callback error handler
+    int luaErrorHandlerRef_;
+    /// Reference to Lua function exposed as @c qlua.wait
+    int waitFunctionRef_;
+    /// Signals resolved by @c qlua.connect, @c qlua.disconnect and @c qlua.wait
+    QHash< SignatureKey, SignalInfo > signalCache_;
+    /// Target methods resolved by @c qlua.connect and @c qlua.disconnect
+    QHash< SignatureKey, MethodIndexInfo > methodCache_;
     /// @brief Dispatcher object: signal->dispatcher->Lua function connection.
     ///
     /// Each time a connection between a Qt signal and a Lua function is requested
@@ -269,7 +533,8 @@ QList< T > GetValues( const LuaContext& lc, const QString& name ) {
 template <>
 inline QString GetValue< QString >( const LuaContext& lc, const QString& name ) {
     lua_getglobal( lc.LuaState(), name.toAscii().constData() );
-    return luaL_checkstring( lc.LuaState(), -1 );
+    luaL_checkstring( lc.LuaState(), -1 );
+    return LuaToQString( lc.LuaState(), -1 );
 }
 
 /// Extract Lua table as variant map.
@@ -35,13 +35,20 @@ extern "C" {
 
 #include <iostream>
 #include <string>
+#include <iterator>
 
 #include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QSet>
 #include <QVariant>
 #include <QVariantMap>
 #include <QGenericArgument>
 #include <QList>
 #include <QVector>
+#include <QObject>
+
+#include <new>
 
 #define QLUA_LIST_FLOAT64 "QList<double>"
 #define QLUA_LIST_FLOAT32 "QList<float>"
@@ -69,16 +76,134 @@ template <> inline const char* TypeName< QVector< int > >() { return QLUA_VECTOR
 template <> inline const char* TypeName< QVector< short > >() { return QLUA_VECTOR_SHORT; }
 template <> inline const char* TypeName< QList< QString > >() { return QLUA_STRING_LIST; }
 
+#ifndef QLUA_ASCII_BUFFER
+/// Size of stack buffer used to push ASCII strings without creating an
+/// intermediate UTF-8 copy on the heap.
+#define QLUA_ASCII_BUFFER 256
+#endif
+
+//------------------------------------------------------------------------------
+/// @brief Push QString on the Lua stack as UTF-8 encoded string.
+///
+/// Short ASCII strings are narrowed into a stack buffer, other strings are
+/// converted through QString::toUtf8.
+/// @param L Lua state
+/// @param s string
+inline
+void PushQString( lua_State* L, const QString& s ) {
+    const int size = s.size();
+    if( size <= QLUA_ASCII_BUFFER ) {
+        char buffer[ QLUA_ASCII_BUFFER ];
+        const QChar* data = s.constData();
+        int i = 0;
+        for( ; i != size && data[ i ].unicode() < 0x80; ++i ) {
+            buffer[ i ] = char( data[ i ].unicode() );
+        }
+        if( i == size ) {
+            lua_pushlstring( L, buffer, size );
+            return;
+        }
+    }
+    const QByteArray utf8 = s.toUtf8();
+    lua_pushlstring( L, utf8.constData(), utf8.size() );
+}
+
 //------------------------------------------------------------------------------
+/// @brief Create QString from UTF-8 encoded Lua string or number.
+///
+/// ASCII strings are converted through QString::fromLatin1, which does not
+/// need to decode multi-byte sequences.
+/// @param L Lua state
+/// @param idx index of value in Lua stack
+/// @return string, null string if the value is not a string or a number
+inline
+QString LuaToQString( lua_State* L, int idx ) {
+    size_t len = 0;
+    const char* s = lua_tolstring( L, idx, &len );
+    if( !s ) return QString();
+    for( size_t i = 0; i != len; ++i ) {
+        if( static_cast< unsigned char >( s[ i ] ) >= 0x80 ) {
+            return QString::fromUtf8( s, int( len ) );
+        }
+    }
+    return QString::fromLatin1( s, int( len ) );
+}
+
+//------------------------------------------------------------------------------
+/// @brief Convert table key to QString: strings are converted as is, integral
+/// numbers in decimal notation and other numbers with the precision used by Lua.
 inline
 QString LuaKeyToQString( lua_State* L, int idx ) {
-    if( lua_isnumber( L, idx ) ) {
-        return QString( "%1" ).arg( lua_tointeger( L, idx ) );
-    } else if( lua_isstring( L, idx ) ) {
-        return lua_tostring( L, idx );
+    const int type = lua_type( L, idx );
+    if( type == LUA_TNUMBER ) {
+        const lua_Number n = lua_tonumber( L, idx );
+        // out of range and non-finite numbers are not converted to integers,
+        // which would be undefined; 2^63 is the first value out of range
+        if( n >= -9223372036854775808.0 && n < 9223372036854775808.0 ) {
+            const qlonglong i = qlonglong( n );
+            if( lua_Number( i ) == n ) return QString::number( i );
+        }
+        return QString::number( n, 'g', 14 );
+    } else if( type == LUA_TSTRING ) {
+        return LuaToQString( L, idx );
     } else return "";
 }
 
+//------------------------------------------------------------------------------
+/// @brief Return true if value is a userdata created by LuaContext to
+/// reference a QObject.
+///
+/// Such userdata are identified by the 'qobject__' field of their metatable,
+/// any other userdata is rejected.
+inline
+bool IsQObjectHandle( lua_State* L, int idx ) {
+    if( lua_type( L, idx ) != LUA_TUSERDATA || !lua_getmetatable( L, idx ) ) return false;
+    lua_pushstring( L, "qobject__" );
+    lua_rawget( L, -2 );
+    const bool handle = lua_toboolean( L, -1 ) != 0;
+    lua_pop( L, 2 );
+    return handle;
+}
+
+//------------------------------------------------------------------------------
+/// @brief Return true if Lua value references a QObject.
+///
+/// The value can be a table created by LuaContext::AddQObject, a QObject proxy
+/// userdata or light userdata; the referenced QObject might have been deleted.
+inline
+bool LuaValueIsQObject( lua_State* L, int idx ) {
+    if( lua_istable( L, idx ) ) {
+        lua_getfield( L, idx, "qobject__" );
+        const bool handle = IsQObjectHandle( L, -1 );
+        lua_pop( L, 1 );
+        return handle;
+    } else return lua_islightuserdata( L, idx ) || IsQObjectHandle( L, idx );
+}
+
+//------------------------------------------------------------------------------
+/// @brief Return QObject pointer from Lua value.
+///
+/// The value can be a table created by LuaContext::AddQObject, a QObject proxy
+/// userdata or a QObject pointer stored as light userdata.
+/// @param L Lua state
+/// @param idx index of value in Lua stack
+/// @return QObject pointer or null if value does not reference a QObject 
+inline
+QObject* LuaValueToQObject( lua_State* L, int idx ) {
+    if( lua_istable( L, idx ) ) {
+        lua_getfield( L, idx, "qobject__" );
+        // userdata layout: pointer to QObject is the first data member
+        QObject* obj = IsQObjectHandle( L, -1 ) ?
+                       *reinterpret_cast< QObject** >( lua_touserdata( L, -1 ) ) : 0;
+        lua_pop( L, 1 );
+        return obj;
+    } else if( lua_islightuserdata( L, idx ) ) {
+        return reinterpret_cast< QObject* >( lua_touserdata( L, idx ) );
+    } else if( IsQObjectHandle( L, idx ) ) {
+        return *reinterpret_cast< QObject** >( lua_touserdata( L, idx ) );
+    } else return 0;
+}
+
 //------------------------------------------------------------------------------
 template < typename ToT, typename FromT >
 bool ConvertibleTo( FromT v ) {
@@ -111,10 +236,86 @@ QVariant LuaValueToQVariant( lua_State* L, int idx ) {
     } else if( lua_islightuserdata( L, idx ) ) {
         return lua_topointer( L, idx ); 
     } else if( lua_isstring( L, idx ) ) {
-        return lua_tostring( L, idx );
+        return LuaToQString( L, idx );
     } else return QVariant();
 }
 
+#ifndef QLUA_BULK_CHUNK
+/// Number of table elements pushed on the Lua stack at once by bulk conversion
+/// routines.
+#define QLUA_BULK_CHUNK 64
+#endif
+
+//------------------------------------------------------------------------------
+/// @brief Return size of array part of table
+inline
+int LuaArrayLength( lua_State* L, int stackTableIndex ) {
+#if LUA_VERSION_NUM > 501 
+    return int( lua_rawlen( L, stackTableIndex ) );
+#else
+    return int( lua_objlen( L, stackTableIndex ) );
+#endif
+}
+
+//------------------------------------------------------------------------------
+/// @brief Read elements [1, n] of Lua table into output iterator, converting
+/// each element to number type T.
+///
+/// Elements are pushed on the Lua stack in chunks of QLUA_BULK_CHUNK elements
+/// and each chunk is removed from the stack with a single call to @c lua_pop.
+/// No Lua error is raised: elements which are not numbers are converted to zero.
+/// @param L Lua State
+/// @param stackTableIndex index of table in Lua stack
+/// @param n number of elements to read
+/// @param out output iterator
+/// @return @c false if any element is neither a number nor a string
+///         convertible to a number
+template < typename T, typename OutputIterator >
+bool ReadLuaNumberArray( lua_State* L, int stackTableIndex, int n, OutputIterator out ) {
+    if( stackTableIndex < 0 ) stackTableIndex = lua_gettop( L ) + stackTableIndex + 1;
+    const int chunk = lua_checkstack( L, QLUA_BULK_CHUNK ) ? QLUA_BULK_CHUNK : 1;
+    bool ok = true;
+    for( int i = 1; i <= n; i += chunk ) {
+        const int count = n - i + 1 < chunk ? n - i + 1 : chunk;
+        for( int j = 0; j != count; ++j ) lua_rawgeti( L, stackTableIndex, i + j );
+        for( int j = -count; j != 0; ++j, ++out ) {
+            if( !lua_isnumber( L, j ) ) ok = false;
+            *out = T( lua_tonumber( L, j ) );
+        }
+        lua_pop( L, count );
+    }
+    return ok;
+}
+
+//------------------------------------------------------------------------------
+/// @brief Append elements [1, n] of Lua table to QStringList.
+///
+/// Elements are read in chunks as in ReadLuaNumberArray; no Lua error is
+/// raised: elements which are neither strings nor numbers are converted to
+/// null strings.
+/// @param L Lua State
+/// @param stackTableIndex index of table in Lua stack
+/// @param list string list
+/// @return @c false if any element is neither a string nor a number
+inline
+bool ReadLuaStringArray( lua_State* L, int stackTableIndex, QStringList& list ) {
+    if( stackTableIndex < 0 ) stackTableIndex = lua_gettop( L ) + stackTableIndex + 1;
+    const int n = LuaArrayLength( L, stackTableIndex );
+    list.reserve( list.size() + n );
+    const int chunk = lua_checkstack( L, QLUA_BULK_CHUNK ) ? QLUA_BULK_CHUNK : 1;
+    bool ok = true;
+    for( int i = 1; i <= n; i += chunk ) {
+        const int count = n - i + 1 < chunk ? n - i + 1 : chunk;
+        for( int j = 0; j != count; ++j ) lua_rawgeti( L, stackTableIndex, i + j );
+        for( int j = -count; j != 0; ++j ) {
+            if( !lua_isstring( L, j ) ) ok = false;
+            list.push_back( LuaToQString( L, j ) );
+        }
+        lua_pop( L, count );
+    }
+    return ok;
+}
+
 //------------------------------------------------------------------------------
 /// @brief Create QList<T> from Lua table where T is @c int @c short @c float or @c double
 ///
@@ -122,20 +323,11 @@ QVariant LuaValueToQVariant( lua_State* L, int idx ) {
 /// @param stackTableIndex index of table in Lua stack
 template < typename T >
 QList< T > ParseLuaTableAsNumberList( lua_State* L, int stackTableIndex ) {
-      luaL_checktype( L, stackTableIndex, LUA_TTABLE );
-#if LUA_VERSION_NUM > 501 
-    int tableSize = int( lua_rawlen( L, stackTableIndex ) );
-#else
-    int tableSize = int( lua_objlen( L, stackTableIndex ) );
-#endif
+    luaL_checktype( L, stackTableIndex, LUA_TTABLE );
+    const int tableSize = LuaArrayLength( L, stackTableIndex );
     QList< T > list;
-    list.reserve( int( tableSize ) );
-    ++tableSize;
-    for( int i = 1; i != tableSize; ++i ) {
-        lua_rawgeti( L, stackTableIndex, i );
-        list.push_back( T( lua_tonumber( L, -1 ) ) );
-        lua_pop( L, 1 );
-    }
+    list.reserve( tableSize );
+    ReadLuaNumberArray< T >( L, stackTableIndex, tableSize, std::back_inserter( list ) );
     return list;
 }
 //------------------------------------------------------------------------------
@@ -145,20 +337,9 @@ QList< T > ParseLuaTableAsNumberList( lua_State* L, int stackTableIndex ) {
 /// @param stackTableIndex index of table in Lua stack
 inline
 QStringList ParseLuaTableAsStringList( lua_State* L, int stackTableIndex ) {
-      luaL_checktype( L, stackTableIndex, LUA_TTABLE );
-#if LUA_VERSION_NUM > 501 
-    int tableSize = int( lua_rawlen( L, stackTableIndex ) );
-#else
-    int tableSize = int( lua_objlen( L, stackTableIndex ) );
-#endif
+    luaL_checktype( L, stackTableIndex, LUA_TTABLE );
     QStringList list;
-    list.reserve( int( tableSize ) );
-    ++tableSize;
-    for( int i = 1; i != tableSize; ++i ) {
-        lua_rawgeti( L, stackTableIndex, i );
-        list.push_back( QString( lua_tostring( L, -1 ) ) );
-        lua_pop( L, 1 );
-    }
+    ReadLuaStringArray( L, stackTableIndex, list );
     return list;
 }
 //------------------------------------------------------------------------------
@@ -168,144 +349,479 @@ QStringList ParseLuaTableAsStringList( lua_State* L, int stackTableIndex ) {
 /// @param stackTableIndex index of table in Lua stack
 template < typename T >
 QVector< T > ParseLuaTableAsNumberVector( lua_State* L, int stackTableIndex ) {
-#if LUA_VERSION_NUM > 501 
-    int tableSize = int( lua_rawlen( L, stackTableIndex ) );
-#else
-    int tableSize = int( lua_objlen( L, stackTableIndex ) );
-#endif
-    QVector< T > v;
-    v.resize( int( tableSize ) );
-    ++tableSize;
-    typename QVector< T >::iterator vi = v.begin();
-    for( int i = 1; i != tableSize; ++i, ++vi ) {
-        lua_rawgeti( L, stackTableIndex, i );
-        *vi = T( lua_tonumber( L, -1 ) );
+    const int tableSize = LuaArrayLength( L, stackTableIndex );
+    QVector< T > v( tableSize );
+    ReadLuaNumberArray< T >( L, stackTableIndex, tableSize, v.data() );
+    return v;
+}
+
+//------------------------------------------------------------------------------
+/// @brief Return number of elements of table if its keys are exactly the
+/// integers [1, n], zero otherwise or if table is empty.
+///
+/// Tables whose first key is not a number are detected without traversing
+/// the whole table.
+/// @param L Lua State
+/// @param stackTableIndex absolute index of table in Lua stack
+inline
+int LuaSequenceLength( lua_State* L, int stackTableIndex ) {
+    const int n = LuaArrayLength( L, stackTableIndex );
+    if( n == 0 ) return 0;
+    int count = 0;
+    lua_pushnil( L );
+    while( lua_next( L, stackTableIndex ) != 0 ) {
         lua_pop( L, 1 );
+        const lua_Number k = lua_type( L, -1 ) == LUA_TNUMBER ? lua_tonumber( L, -1 ) : 0;
+        if( k < 1 || k > n || k != lua_Number( int( k ) ) ) {
+            lua_pop( L, 1 );
+            return 0;
+        }
+        ++count;
+    }
+    return count == n ? n : 0;
+}
+
+/// How the top-level table is converted by LuaTableToQVariant
+enum LuaTableConversion {
+    /// QVariantList if the table is a sequence, QVariantMap otherwise
+    TABLE_AUTO,
+    /// QVariantMap, integer keys are converted to strings
+    TABLE_AS_MAP,
+    /// QVariantList, the keys of tables which are not sequences are discarded
+    TABLE_AS_LIST
+};
+
+//------------------------------------------------------------------------------
+/// @brief Table being converted by LuaTableToQVariant.
+struct LuaTableFrame {
+    enum Kind {
+        /// Elements [1, n] read in order into @c list_
+        SEQUENCE,
+        /// Key-value pairs read into @c map_
+        MAP,
+        /// Values read into @c list_ in traversal order
+        VALUES
+    };
+    /// Conversion kind
+    Kind kind_;
+    /// Absolute index of table in Lua stack
+    int table_;
+    /// Number of elements of sequence
+    int size_;
+    /// Index of next element of sequence
+    int next_;
+    /// Key of the value being converted
+    QString key_;
+    /// Converted elements
+    QVariantList list_;
+    /// Converted key-value pairs
+    QVariantMap map_;
+    LuaTableFrame( Kind kind = MAP, int table = 0, int size = 0 )
+        : kind_( kind ), table_( table ), size_( size ), next_( 1 ) {}
+};
+
+//------------------------------------------------------------------------------
+/// @brief Add frame for table at index @c table; the first key is pushed on
+/// the Lua stack for tables traversed with @c lua_next.
+inline
+void BeginLuaTable( lua_State* L, int table, LuaTableConversion conversion,
+                    QVector< LuaTableFrame >& frames ) {
+    const int n = conversion == TABLE_AS_MAP ? 0 : LuaSequenceLength( L, table );
+    if( n > 0 ) {
+        frames.push_back( LuaTableFrame( LuaTableFrame::SEQUENCE, table, n ) );
+        frames.back().list_.reserve( n );
+    } else {
+        frames.push_back( LuaTableFrame( conversion == TABLE_AS_LIST ? LuaTableFrame::VALUES
+                                                                     : LuaTableFrame::MAP,
+                                         table ) );
+        lua_pushnil( L );
     }
-    return v;
+}
+
+//------------------------------------------------------------------------------
+/// @brief Create QVariant from Lua table.
+///
+/// Nested tables which are sequences (keys are exactly the integers [1, n])
+/// are converted to QVariantList, other tables to QVariantMap. Tables are
+/// converted through an explicit stack instead of recursive calls; tables
+/// which contain themselves, directly or indirectly, are converted to
+/// invalid QVariants when reached again.
+/// @param L Lua State
+/// @param stackTableIndex index of table in Lua stack
+/// @param conversion conversion of the top-level table
+inline
+QVariant LuaTableToQVariant( lua_State* L, int stackTableIndex,
+                             LuaTableConversion conversion = TABLE_AUTO ) {
+    luaL_checktype( L, stackTableIndex, LUA_TTABLE );
+    if( stackTableIndex < 0 ) stackTableIndex = lua_gettop( L ) + stackTableIndex + 1;
+    // tables being converted: the Lua stack contains each table followed,
+    // unless it is a sequence, by the current key
+    QVector< LuaTableFrame > frames;
+    QSet< const void* > path;
+    path.insert( lua_topointer( L, stackTableIndex ) );
+    BeginLuaTable( L, stackTableIndex, conversion, frames );
+    QVariant result;
+    while( true ) {
+        LuaTableFrame& f = frames.back();
+        bool next = false;
+        if( f.kind_ == LuaTableFrame::SEQUENCE ) {
+            next = f.next_ <= f.size_;
+            if( next ) lua_rawgeti( L, f.table_, f.next_++ );
+        } else {
+            next = lua_next( L, f.table_ ) != 0;
+            if( next && f.kind_ == LuaTableFrame::MAP ) f.key_ = LuaKeyToQString( L, -2 );
+        }
+        QVariant value;
+        if( next ) {
+            if( lua_istable( L, -1 ) ) {
+                const void* t = lua_topointer( L, -1 );
+                if( !path.contains( t ) && lua_checkstack( L, 3 ) ) {
+                    // the table is left on the stack until converted
+                    path.insert( t );
+                    BeginLuaTable( L, lua_gettop( L ), TABLE_AUTO, frames );
+                    continue;
+                }
+            } else value = LuaValueToQVariant( L, -1 );
+            lua_pop( L, 1 );
+        } else {
+            // all elements converted; the key was removed by lua_next
+            value = f.kind_ == LuaTableFrame::MAP ? QVariant( f.map_ ) : QVariant( f.list_ );
+            path.remove( lua_topointer( L, f.table_ ) );
+            frames.pop_back();
+            if( frames.isEmpty() ) {
+                result = value;
+                break;
+            }
+            lua_pop( L, 1 ); // nested table
+        }
+        LuaTableFrame& parent = frames.back();
+        if( parent.kind_ == LuaTableFrame::MAP ) parent.map_.insert( parent.key_, value );
+        else parent.list_.push_back( value );
+    }
+    return result;
 }
 
 //------------------------------------------------------------------------------
 /// @brief Create QVariantMap from Lua table.
 ///
+/// Nested tables are converted by LuaTableToQVariant.
 /// @param L Lua State
 /// @param stackTableIndex index of table in Lua stack
 /// @param removeTable if @ true table is removed from stack, this is useful
-///        when revursively invoking the function to guarantee that after it
-///        returns no table is left on the stack. 
+///        to guarantee that after the function returns no table is left on
+///        the stack. 
 inline
 QVariantMap ParseLuaTable( lua_State* L, int stackTableIndex, bool removeTable = true ) {
-    luaL_checktype( L, stackTableIndex, LUA_TTABLE );
-    QVariantMap m;
-    lua_pushnil(L);  // first key
-    stackTableIndex = stackTableIndex < 0 ? stackTableIndex - 1 : stackTableIndex;
-    while( lua_next( L, stackTableIndex ) != 0 ) {
-        /* uses 'key' (at index -2) and 'value' (at index -1) */
-        QString key = LuaKeyToQString( L, -2 );
-        QVariant value = lua_istable( L, -1 ) ? ParseLuaTable( L, -1, false ) : 
-                         LuaValueToQVariant( L, -1 );
-        m[ key ] = value;
-        lua_pop(L, 1);
-    }
+    const QVariantMap m = LuaTableToQVariant( L, stackTableIndex, TABLE_AS_MAP ).toMap();
     if( removeTable ) lua_pop( L, 1 ); // remvove table
     return m;
 }
 //------------------------------------------------------------------------------
 /// @brief Create QVariantList from Lua table.
 ///
+/// Elements of sequences are read in order, values of other tables in
+/// traversal order. Nested tables are converted by LuaTableToQVariant.
 /// @param L Lua State
 /// @param stackTableIndex index of table in Lua stack
 inline
 QVariantList ParseLuaTableAsVariantList( lua_State* L, int stackTableIndex ) {
-    luaL_checktype( L, stackTableIndex, LUA_TTABLE );
-    QVariantList l;
-    lua_pushnil(L);  // first key
-    stackTableIndex = stackTableIndex < 0 ? stackTableIndex - 1 : stackTableIndex;
-    while( lua_next( L, stackTableIndex ) != 0 ) {
-        /* uses 'key' (at index -2) and 'value' (at index -1) */
-        QVariant value = lua_istable( L, -1 ) ? ParseLuaTable( L, -1, false ) : 
-                         LuaValueToQVariant( L, -1 );
-        l.push_back( value );
-        lua_pop(L, 1);
-    }
-    return l;
+    return LuaTableToQVariant( L, stackTableIndex, TABLE_AS_LIST ).toList();
 }
 
 
 //=============================================================================
 // C++ -> Lua
 
+#ifndef QLUA_KEY_CACHE_SIZE
+/// Maximum number of strings stored in a LuaKeyCache.
+#define QLUA_KEY_CACHE_SIZE 4096
+#endif
+
+/// Lua registry field storing the key cache used to convert QVariantMap keys.
+#define QLUA_KEY_CACHE "qlua.keyCache"
+
+//------------------------------------------------------------------------------
+/// @brief Cache of Lua strings frequently pushed as table keys.
+///
+/// Strings are stored as registry references: pushing a cached string is a
+/// single @c lua_rawgeti call instead of a conversion, copy and hash of the
+/// string. C strings are identified by address, only strings which are never
+/// modified or released while the cache is in use, such as the names returned
+/// by QMetaProperty::name, can be cached; QStrings are identified by value.
+/// Strings are not added once the cache contains QLUA_KEY_CACHE_SIZE strings.
+class LuaKeyCache {
+public:
+    /// Push string on the Lua stack and add it to the cache if not found.
+    void Push( lua_State* L, const char* key ) {
+        QHash< const char*, int >::const_iterator i = staticKeys_.find( key );
+        if( i != staticKeys_.end() ) {
+            lua_rawgeti( L, LUA_REGISTRYINDEX, i.value() );
+            return;
+        }
+        lua_pushstring( L, key );
+        if( Size() < QLUA_KEY_CACHE_SIZE ) {
+            lua_pushvalue( L, -1 );
+            staticKeys_.insert( key, luaL_ref( L, LUA_REGISTRYINDEX ) );
+        }
+    }
+    /// @brief Return registry reference to string, add string to the cache if
+    /// not found.
+    /// @return reference or @c LUA_NOREF if the cache is full
+    int Ref( lua_State* L, const QString& key ) {
+        QHash< QString, int >::const_iterator i = keys_.find( key );
+        if( i != keys_.end() ) return i.value();
+        if( Size() >= QLUA_KEY_CACHE_SIZE ) return LUA_NOREF;
+        PushQString( L, key );
+        const int ref = luaL_ref( L, LUA_REGISTRYINDEX );
+        keys_.insert( key, ref );
+        return ref;
+    }
+    /// Release references to cached strings.
+    void Clear( lua_State* L ) {
+        for( QHash< const char*, int >::const_iterator i = staticKeys_.begin();
+             i != staticKeys_.end(); ++i ) {
+            luaL_unref( L, LUA_REGISTRYINDEX, i.value() );
+        }
+        for( QHash< QString, int >::const_iterator i = keys_.begin();
+             i != keys_.end(); ++i ) {
+            luaL_unref( L, LUA_REGISTRYINDEX, i.value() );
+        }
+        staticKeys_.clear();
+        keys_.clear();
+    }
+    /// Return number of cached strings
+    int Size() const { return staticKeys_.size() + keys_.size(); }
+private:
+    /// Map string address to registry reference
+    QHash< const char*, int > staticKeys_;
+    /// Map string value to registry reference
+    QHash< QString, int > keys_;
+};
+
+//------------------------------------------------------------------------------
+/// @brief Return key cache used to convert QVariantMap keys, NULL if map keys
+/// are not cached.
+///
+/// @param L Lua state
+inline
+LuaKeyCache* GetKeyCache( lua_State* L ) {
+    lua_getfield( L, LUA_REGISTRYINDEX, QLUA_KEY_CACHE );
+    LuaKeyCache* keys = reinterpret_cast< LuaKeyCache* >( lua_touserdata( L, -1 ) );
+    lua_pop( L, 1 );
+    return keys;
+}
+//------------------------------------------------------------------------------
+/// @brief Set key cache used to convert QVariantMap keys.
+///
+/// @param L Lua state
+/// @param keys key cache, NULL to disable caching of map keys
+inline
+void SetKeyCache( lua_State* L, LuaKeyCache* keys ) {
+    if( keys ) lua_pushlightuserdata( L, keys );
+    else lua_pushnil( L );
+    lua_setfield( L, LUA_REGISTRYINDEX, QLUA_KEY_CACHE );
+}
+
+//------------------------------------------------------------------------------
+/// @brief Keys of the last QVariantMap converted as an element of a
+/// QVariantList.
+///
+/// Lists of records usually contain maps with the same keys: consecutive
+/// maps with the same keys as the previous one reuse the key references
+/// without looking them up in the key cache. Keys sharing data, as keys
+/// copied from the same map usually do, are compared by address; other keys
+/// are compared by value.
+struct MapSchema {
+    /// Keys in iteration order
+    QVector< QString > keys_;
+    /// Registry references to Lua strings, @c LUA_NOREF if not cached
+    QVector< int > refs_;
+};
+
 void VariantMapToLuaTable( const QVariantMap&, lua_State* );
 void VariantListToLuaTable( const QVariantList&, lua_State* );
+void VariantMapToLuaTable( const QVariantMap&, lua_State*, LuaKeyCache*, MapSchema* = 0 );
+void VariantListToLuaTable( const QVariantList&, lua_State*, LuaKeyCache* );
+void StringListToLuaTable( const QStringList&, lua_State* );
 
 //------------------------------------------------------------------------------
 /// @brief Create Lua value from QVariant and push it on the Lua stack.
 ///
 /// @param v QVariant
 /// @param L Lua state
+/// @param keys key cache used to push QVariantMap keys, can be NULL
 inline
-void VariantToLuaValue( const QVariant& v, lua_State* L ) {
+void VariantToLuaValue( const QVariant& v, lua_State* L, LuaKeyCache* keys ) {
 
-    switch( v.type() ) {
-        case QVariant::Map: VariantMapToLuaTable( v.toMap(), L );
-                            break;
-        case QVariant::List: VariantListToLuaTable( v.toList(), L );
+    switch( v.userType() ) {
+        case QMetaType::QVariantMap: VariantMapToLuaTable( v.toMap(), L, keys );
+                                     break;
+        case QMetaType::QVariantList: VariantListToLuaTable( v.toList(), L, keys );
+                                      break;
+        case QMetaType::QStringList: StringListToLuaTable( v.toStringList(), L );
+                                     break;
+        case QMetaType::QString: PushQString( L, v.toString() );
+                                 break; 
+        case QMetaType::QByteArray: {
+                                        const QByteArray ba = v.toByteArray();
+                                        lua_pushlstring( L, ba.constData(), ba.size() );
+                                    }
+                                    break;
+        // dates and times in ISO 8601 format
+        case QMetaType::QChar:
+        case QMetaType::QDate:
+        case QMetaType::QTime:
+        case QMetaType::QDateTime:
+        case QMetaType::QUrl: PushQString( L, v.toString() );
+                              break;
+        case QMetaType::Int: lua_pushinteger( L, v.toInt() );
                              break;
-        case QVariant::String: lua_pushstring( L, v.toString().toAscii().constData() );
-                               break; 
-        case QVariant::Int: lua_pushinteger( L, v.toInt() );
-                            break;
-        case QVariant::UInt: lua_pushnumber( L, v.toUInt() );
-                             break;
-        case QVariant::LongLong: lua_pushnumber( L, v.toLongLong() );
-                                 break;
-        case QVariant::ULongLong: lua_pushnumber( L, v.toULongLong() );
+        case QMetaType::UInt: lua_pushnumber( L, v.toUInt() );
+                              break;
+        case QMetaType::LongLong: lua_pushnumber( L, v.toLongLong() );
                                   break;
-        case QVariant::Bool: lua_pushboolean( L, v.toBool() );
-                             break;
-        case QVariant::Double: lua_pushnumber( L, v.toDouble() );
+        case QMetaType::ULongLong: lua_pushnumber( L, v.toULongLong() );
+                                   break;
+        case QMetaType::Long: lua_pushnumber( L, v.value< long >() );
+                              break;
+        case QMetaType::ULong: lua_pushnumber( L, v.value< unsigned long >() );
+                               break;
+        case QMetaType::Short: lua_pushinteger( L, v.value< short >() );
+                               break;
+        case QMetaType::UShort: lua_pushinteger( L, v.value< unsigned short >() );
+                                break;
+        case QMetaType::Char: lua_pushinteger( L, v.value< char >() );
+                              break;
+        case QMetaType::UChar: lua_pushinteger( L, v.value< unsigned char >() );
                                break;
-        default: break;
+        case QMetaType::Bool: lua_pushboolean( L, v.toBool() );
+                              break;
+        case QMetaType::Double: lua_pushnumber( L, v.toDouble() );
+                                break;
+        case QMetaType::Float: lua_pushnumber( L, v.value< float >() );
+                               break;
+        case QMetaType::VoidStar: lua_pushlightuserdata( L, v.value< void* >() );
+                                  break;
+        case QMetaType::QObjectStar: lua_pushlightuserdata( L, v.value< QObject* >() );
+                                     break;
+        // invalid and unsupported values: nil keeps the stack balanced
+        default: lua_pushnil( L );
+                 break;
     }
 }
 
+//------------------------------------------------------------------------------
+/// @brief Create Lua value from QVariant and push it on the Lua stack.
+///
+/// QVariantMap keys are pushed from the key cache set through SetKeyCache,
+/// if any.
+/// @param v QVariant
+/// @param L Lua state
+inline
+void VariantToLuaValue( const QVariant& v, lua_State* L ) {
+    const bool container = v.type() == QVariant::Map || v.type() == QVariant::List;
+    VariantToLuaValue( v, L, container ? GetKeyCache( L ) : 0 );
+}
+
 //------------------------------------------------------------------------------
 /// @brief Create Lua table from QVariantMap and push it on the Lua stack.
 ///
 /// @param vm QVariantMap
 /// @param L Lua state
+/// @param keys key cache used to push keys, can be NULL
+/// @param schema keys of the previously converted map, updated with the keys
+///        of this map; can be NULL
 inline
-void VariantMapToLuaTable( const QVariantMap& vm, lua_State* L ) {
-    lua_newtable( L ); 
-    for( QVariantMap::const_iterator i = vm.begin(); i != vm.end(); ++i ) {
-        lua_pushstring( L, i.key().toAscii().constData() );
-        VariantToLuaValue( i.value(), L );
+void VariantMapToLuaTable( const QVariantMap& vm, lua_State* L,
+                           LuaKeyCache* keys, MapSchema* schema ) {
+    // key, value and nested table
+    lua_checkstack( L, 3 );
+    lua_createtable( L, 0, vm.size() );
+    if( !keys ) {
+        for( QVariantMap::const_iterator i = vm.begin(); i != vm.end(); ++i ) {
+            PushQString( L, i.key() );
+            VariantToLuaValue( i.value(), L, 0 );
+            lua_rawset( L, -3 );
+        }
+        return;
+    }
+    // the schema is reused as long as keys match, and overwritten from the
+    // first key which does not match
+    bool match = schema && schema->keys_.size() == vm.size();
+    if( schema && !match ) {
+        schema->keys_.resize( vm.size() );
+        schema->refs_.resize( vm.size() );
+    }
+    int k = 0;
+    for( QVariantMap::const_iterator i = vm.begin(); i != vm.end(); ++i, ++k ) {
+        int ref = LUA_NOREF;
+        if( match && ( schema->keys_[ k ].isSharedWith( i.key() )
+                       || schema->keys_[ k ] == i.key() ) ) {
+            ref = schema->refs_[ k ];
+        } else {
+            match = false;
+            ref = keys->Ref( L, i.key() );
+            if( schema ) {
+                schema->keys_[ k ] = i.key();
+                schema->refs_[ k ] = ref;
+            }
+        }
+        if( ref != LUA_NOREF ) lua_rawgeti( L, LUA_REGISTRYINDEX, ref );
+        else PushQString( L, i.key() );
+        VariantToLuaValue( i.value(), L, keys );
         lua_rawset( L, -3 );
     }
 }
 //------------------------------------------------------------------------------
+/// @brief Create Lua table from QVariantMap and push it on the Lua stack.
+///
+/// Keys are pushed from the key cache set through SetKeyCache, if any.
+/// @param vm QVariantMap
+/// @param L Lua state
+inline
+void VariantMapToLuaTable( const QVariantMap& vm, lua_State* L ) {
+    VariantMapToLuaTable( vm, L, GetKeyCache( L ) );
+}
+//------------------------------------------------------------------------------
 /// @brief Create Lua table from QVariantList and push it on the Lua stack.
 ///
 /// @param vl QVariantList
 /// @param L Lua state
+/// @param keys key cache used to push QVariantMap keys, can be NULL
 inline
-void VariantListToLuaTable( const QVariantList& vl, lua_State* L ) {
-    lua_newtable( L ); 
+void VariantListToLuaTable( const QVariantList& vl, lua_State* L, LuaKeyCache* keys ) {
+    lua_checkstack( L, 3 );
+    lua_createtable( L, vl.size(), 0 );
+    // maps in the same list usually share the same keys
+    MapSchema schema;
     int i = 1;
     for( QVariantList::const_iterator v = vl.begin(); v != vl.end(); ++v, ++i ) {
         lua_pushinteger( L, i );
-        VariantToLuaValue( *v, L );
+        if( keys && v->type() == QVariant::Map ) {
+            VariantMapToLuaTable( v->toMap(), L, keys, &schema );
+        } else VariantToLuaValue( *v, L, keys );
         lua_rawset( L, -3 );
     }
 }
 //------------------------------------------------------------------------------
+/// @brief Create Lua table from QVariantList and push it on the Lua stack.
+///
+/// QVariantMap keys are pushed from the key cache set through SetKeyCache,
+/// if any.
+/// @param vl QVariantList
+/// @param L Lua state
+inline
+void VariantListToLuaTable( const QVariantList& vl, lua_State* L ) {
+    VariantListToLuaTable( vl, L, GetKeyCache( L ) );
+}
+//------------------------------------------------------------------------------
 /// @brief Create Lua table from QList<T> where T is a number and push it on the Lua stack.
 ///
 /// @param l QList
 /// @param L Lua state
 template < typename T >
 void NumberListToLuaTable( const QList< T >& l, lua_State* L ) {
-    lua_newtable( L ); 
+    lua_createtable( L, l.size(), 0 );
     int i = 1;
     for( typename QList< T >::const_iterator v = l.begin(); v != l.end(); ++v, ++i ) {
         lua_pushnumber( L, *v );
@@ -319,11 +835,12 @@ void NumberListToLuaTable( const QList< T >& l, lua_State* L ) {
 /// @param L Lua state
 template < typename T >
 void NumberVectorToLuaTable( const QVector< T >& v, lua_State* L ) {
-    lua_newtable( L ); 
-    int i = 1;
-    for( typename QVector< T >::const_iterator vi = v.begin(); vi != v.end(); ++vi, ++i ) {
-        lua_pushnumber( L, *vi );
-        lua_rawseti( L, -2, i );
+    const int size = v.size();
+    lua_createtable( L, size, 0 );
+    const T* data = v.constData();
+    for( int i = 0; i != size; ++i ) {
+        lua_pushnumber( L, data[ i ] );
+        lua_rawseti( L, -2, i + 1 );
     }
 }
 //------------------------------------------------------------------------------
@@ -333,12 +850,244 @@ void NumberVectorToLuaTable( const QVector< T >& v, lua_State* L ) {
 /// @param L Lua state
 inline
 void StringListToLuaTable( const QStringList& sl, lua_State* L ) {
-    lua_newtable( L ); 
+    lua_createtable( L, sl.size(), 0 );
     int i = 1;
     for( QStringList::const_iterator v = sl.begin(); v != sl.end(); ++v, ++i ) {
-        lua_pushinteger( L, i );
-        lua_pushstring( L, v->toAscii().constData() );
-        lua_rawset( L, -3 );
+        PushQString( L, *v );
+        lua_rawseti( L, -2, i );
+    }
+}
+
+//==============================================================================
+// Main Lua state
+
+/// Lua registry field storing the main thread of the Lua state, Lua 5.1 only.
+#define QLUA_MAIN_THREAD "qlua.mainThread"
+
+//------------------------------------------------------------------------------
+/// @brief Store main thread of the Lua state into the registry.
+///
+/// Required by LuaMainState with Lua 5.1, which does not store it.
+/// @param L main Lua state
+inline
+void SetLuaMainState( lua_State* L ) {
+#if LUA_VERSION_NUM > 501
+    (void) L;
+#else
+    lua_pushthread( L );
+    lua_setfield( L, LUA_REGISTRYINDEX, QLUA_MAIN_THREAD );
+#endif
+}
+//------------------------------------------------------------------------------
+/// @brief Return main thread of the Lua state, which lives as long as the Lua
+/// state; @c L itself if the main thread is not known.
+///
+/// @param L Lua state or coroutine
+inline
+lua_State* LuaMainState( lua_State* L ) {
+#if LUA_VERSION_NUM > 501
+    lua_rawgeti( L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD );
+#else
+    lua_getfield( L, LUA_REGISTRYINDEX, QLUA_MAIN_THREAD );
+#endif
+    lua_State* main = lua_isthread( L, -1 ) ? lua_tothread( L, -1 ) : L;
+    lua_pop( L, 1 );
+    return main;
+}
+
+//==============================================================================
+// Typed arrays
+
+/// Lua registry field enabling typed arrays.
+#define QLUA_TYPED_ARRAYS "qlua.typedArrays"
+
+//------------------------------------------------------------------------------
+/// @brief Return @c true if QVector<T> values are pushed on the Lua stack as
+/// typed arrays instead of Lua tables.
+///
+/// @param L Lua state
+inline
+bool TypedArraysEnabled( lua_State* L ) {
+    lua_getfield( L, LUA_REGISTRYINDEX, QLUA_TYPED_ARRAYS );
+    const bool enabled = lua_toboolean( L, -1 ) != 0;
+    lua_pop( L, 1 );
+    return enabled;
+}
+//------------------------------------------------------------------------------
+/// @brief Enable/disable typed arrays.
+///
+/// @param L Lua state
+/// @param on if @c true QVector<T> values are pushed as typed arrays
+inline
+void SetTypedArraysEnabled( lua_State* L, bool on ) {
+    lua_pushboolean( L, on );
+    lua_setfield( L, LUA_REGISTRYINDEX, QLUA_TYPED_ARRAYS );
+}
+//------------------------------------------------------------------------------
+/// @brief Return pointer to QVector<T> wrapped by the typed array at position
+/// @c idx in the Lua stack or NULL if the value is not a typed array of type T.
+///
+/// @param L Lua state
+/// @param idx index of value in Lua stack
+template < typename T >
+QVector< T >* ToTypedArray( lua_State* L, int idx ) {
+    if( lua_type( L, idx ) != LUA_TUSERDATA || !lua_getmetatable( L, idx ) ) return 0;
+    luaL_getmetatable( L, TypeName< QVector< T > >() );
+    const bool typedArray = lua_rawequal( L, -1, -2 ) != 0;
+    lua_pop( L, 2 );
+    return typedArray ? reinterpret_cast< QVector< T >* >( lua_touserdata( L, idx ) ) : 0;
+}
+//------------------------------------------------------------------------------
+/// @brief @c __index method of typed arrays: return element at 1-based index
+/// or nil if index is out of range.
+template < typename T >
+int TypedArrayIndex( lua_State* L ) {
+    const QVector< T >& v = *reinterpret_cast< QVector< T >* >( lua_touserdata( L, 1 ) );
+    const int i = lua_type( L, 2 ) == LUA_TNUMBER ? int( lua_tointeger( L, 2 ) ) - 1 : -1;
+    if( i < 0 || i >= v.size() ) lua_pushnil( L );
+    else lua_pushnumber( L, v[ i ] );
+    return 1;
+}
+//------------------------------------------------------------------------------
+/// @brief @c __newindex method of typed arrays: set element at 1-based index;
+/// assigning the element following the last one appends a new element.
+///
+/// The first write to data shared with other QVector instances detaches the
+/// vector (copy-on-write).
+template < typename T >
+int TypedArrayNewIndex( lua_State* L ) {
+    QVector< T >& v = *reinterpret_cast< QVector< T >* >( lua_touserdata( L, 1 ) );
+    const int i = int( luaL_checkinteger( L, 2 ) ) - 1;
+    const T value = T( luaL_checknumber( L, 3 ) );
+    if( i < 0 || i > v.size() ) return luaL_error( L, "Typed array index out of range" );
+    if( i == v.size() ) v.push_back( value );
+    else v[ i ] = value;
+    return 0;
+}
+//------------------------------------------------------------------------------
+/// @brief @c __len method of typed arrays: return number of elements.
+template < typename T >
+int TypedArrayLen( lua_State* L ) {
+    lua_pushinteger( L, reinterpret_cast< QVector< T >* >( lua_touserdata( L, 1 ) )->size() );
+    return 1;
+}
+//------------------------------------------------------------------------------
+/// @brief @c __gc method of typed arrays: release reference to vector data.
+template < typename T >
+int TypedArrayGC( lua_State* L ) {
+    reinterpret_cast< QVector< T >* >( lua_touserdata( L, 1 ) )->~QVector< T >();
+    return 0;
+}
+//------------------------------------------------------------------------------
+/// @brief Create typed array from QVector<T> and push it on the Lua stack.
+///
+/// A typed array is a userdata storing a QVector<T> which shares the data with
+/// the passed vector: no element is copied. Elements are accessed from Lua
+/// with the @c [] operator (1-based) and the number of elements is returned by
+/// the @c # operator. Typed arrays passed to methods accepting a QVector<T>
+/// share the data with the parameter as well.
+/// @param v QVector
+/// @param L Lua state
+template < typename T >
+void PushTypedArray( const QVector< T >& v, lua_State* L ) {
+    new ( lua_newuserdata( L, sizeof( QVector< T > ) ) ) QVector< T >( v );
+    if( luaL_newmetatable( L, TypeName< QVector< T > >() ) ) {
+        lua_pushcfunction( L, TypedArrayIndex< T > );
+        lua_setfield( L, -2, "__index" );
+        lua_pushcfunction( L, TypedArrayNewIndex< T > );
+        lua_setfield( L, -2, "__newindex" );
+        lua_pushcfunction( L, TypedArrayLen< T > );
+        lua_setfield( L, -2, "__len" );
+        lua_pushcfunction( L, TypedArrayGC< T > );
+        lua_setfield( L, -2, "__gc" );
+        // marks userdata as not wrapping a QObject
+        lua_pushboolean( L, 1 );
+        lua_setfield( L, -2, "typedarray__" );
+    }
+    lua_setmetatable( L, -2 );
+}
+//------------------------------------------------------------------------------
+/// @brief Return @c true if the value at position @c idx is a typed array of
+/// any element type.
+inline
+bool IsTypedArray( lua_State* L, int idx ) {
+    if( lua_type( L, idx ) != LUA_TUSERDATA || !lua_getmetatable( L, idx ) ) return false;
+    lua_pushstring( L, "typedarray__" );
+    lua_rawget( L, -2 );
+    const bool typedArray = lua_toboolean( L, -1 ) != 0;
+    lua_pop( L, 2 );
+    return typedArray;
+}
+//------------------------------------------------------------------------------
+/// @brief If the value at position @c idx is a typed array of type E append
+/// its elements to container @c c converting them to type T.
+///
+/// Elements are read directly from the contiguous vector data, without
+/// accessing the Lua stack.
+/// @return @c true if the value is a typed array of type E
+template < typename T, typename E, typename C >
+bool AppendTypedArrayOf( lua_State* L, int idx, C& c ) {
+    const QVector< E >* v = ToTypedArray< E >( L, idx );
+    if( !v ) return false;
+    c.reserve( c.size() + v->size() );
+    for( const E* i = v->constBegin(); i != v->constEnd(); ++i ) c.push_back( T( *i ) );
+    return true;
+}
+//------------------------------------------------------------------------------
+/// @brief If the value at position @c idx is a typed array of any element type
+/// append its elements to container @c c converting them to type T.
+///
+/// @return @c true if the value is a typed array
+template < typename T, typename C >
+bool AppendTypedArray( lua_State* L, int idx, C& c ) {
+    return AppendTypedArrayOf< T, double >( L, idx, c )
+           || AppendTypedArrayOf< T, float >( L, idx, c )
+           || AppendTypedArrayOf< T, int >( L, idx, c )
+           || AppendTypedArrayOf< T, short >( L, idx, c );
+}
+//------------------------------------------------------------------------------
+/// @brief Return C name of typed array element type, usable to cast the data
+/// pointer with LuaJIT's @c ffi.cast.
+template < typename T > const char* ElementTypeName();
+
+template <> inline const char* ElementTypeName< double >() { return "double"; }
+template <> inline const char* ElementTypeName< float >() { return "float"; }
+template <> inline const char* ElementTypeName< int >() { return "int"; }
+template <> inline const char* ElementTypeName< short >() { return "short"; }
+
+//------------------------------------------------------------------------------
+/// @brief If the value at position @c idx is a typed array of type T push
+/// pointer to its contiguous data, number of elements and element type name.
+///
+/// The data is detached from other vectors sharing it, so that it can be
+/// written through the returned pointer. The pointer is valid as long as the
+/// typed array is referenced and no element is appended.
+/// @return @c true if the value is a typed array of type T
+template < typename T >
+bool PushTypedArrayData( lua_State* L, int idx ) {
+    QVector< T >* v = ToTypedArray< T >( L, idx );
+    if( !v ) return false;
+    lua_pushlightuserdata( L, v->data() );
+    lua_pushinteger( L, v->size() );
+    lua_pushstring( L, ElementTypeName< T >() );
+    return true;
+}
+//------------------------------------------------------------------------------
+/// @brief Lua function returning the data pointer, size and element type name
+/// of a typed array.
+///
+/// Used from LuaJIT to access typed arrays through FFI without crossing the
+/// Lua/C boundary for each element:
+/// @code
+/// local p, n, t = qlua.typedArrayData( a )
+/// local d = ffi.cast( t .. '*', p ) -- 0-based
+/// @endcode
+inline
+int TypedArrayData( lua_State* L ) {
+    if( PushTypedArrayData< double >( L, 1 ) || PushTypedArrayData< float >( L, 1 )
+        || PushTypedArrayData< int >( L, 1 ) || PushTypedArrayData< short >( L, 1 ) ) {
+        return 3;
     }
+    return luaL_argerror( L, 1, "typed array expected" );
 }
 }
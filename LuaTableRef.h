@@ -0,0 +1,223 @@
+#pragma once
+//QLua - Copyright (c) 2012, Ugo Varetto
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author and copyright holder nor the
+//       names of contributors to the project may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL UGO VARETTO BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+///@file
+///@brief Reference to Lua table passed to QObject methods without conversion.
+
+extern "C" {
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+}
+
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QVariantMap>
+#include <QSharedPointer>
+
+#include "LuaQtTypes.h"
+
+/// Meta type name of qlua::LuaTableRef
+#define QLUA_TABLE_REF "qlua::LuaTableRef"
+
+namespace qlua {
+
+//------------------------------------------------------------------------------
+/// @brief Reference to a Lua table: methods with a parameter of this type
+/// receive the table passed from Lua without any conversion, and values are
+/// read from the table only when requested.
+///
+/// Copies share the same registry reference, which is released when the last
+/// copy is destroyed. Fields are accessed through raw gets: metamethods are
+/// not invoked, and no Lua error is raised. Values are accessed through the
+/// main Lua state, which lives as long as the Lua state, also when the table
+/// was passed from a coroutine. References must not outlive the LuaContext
+/// and must only be used from the thread of the LuaContext.
+///
+/// Methods must declare the parameter type as @c qlua::LuaTableRef.
+class LuaTableRef {
+public:
+    /// Create invalid reference
+    LuaTableRef() {}
+    /// @brief Create reference to table.
+    /// @param L Lua state or coroutine
+    /// @param stackTableIndex index of table in Lua stack
+    /// @param mainState main Lua state, returned by LuaMainState
+    LuaTableRef( lua_State* L, int stackTableIndex, lua_State* mainState )
+        : data_( new Data( mainState ) ) {
+        lua_pushvalue( L, stackTableIndex );
+        data_->ref_ = luaL_ref( L, LUA_REGISTRYINDEX );
+    }
+    /// Return @c true if the reference was created from a table
+    bool IsValid() const { return !data_.isNull(); }
+    /// Push table on the Lua stack, nil if the reference is invalid
+    void Push( lua_State* L ) const {
+        if( data_ ) lua_rawgeti( L, LUA_REGISTRYINDEX, data_->ref_ );
+        else lua_pushnil( L );
+    }
+    /// Return length of table as returned by the @c # operator
+    int Length() const {
+        lua_State* L = State();
+        if( !L ) return 0;
+        Push( L );
+        const int length = LuaArrayLength( L, -1 );
+        lua_pop( L, 1 );
+        return length;
+    }
+    /// Return @c true if field is not nil
+    bool Contains( const QString& key ) const {
+        lua_State* L = State();
+        if( !L ) return false;
+        PushField( L, key );
+        const bool found = !lua_isnil( L, -1 );
+        lua_pop( L, 1 );
+        return found;
+    }
+    /// Return value of field; nested tables are converted by
+    /// LuaTableToQVariant, missing fields are returned as invalid QVariants
+    QVariant Value( const QString& key ) const {
+        lua_State* L = State();
+        if( !L ) return QVariant();
+        PushField( L, key );
+        return PopValue( L );
+    }
+    /// Return element at index, starting at 1
+    QVariant Value( int index ) const {
+        lua_State* L = State();
+        if( !L ) return QVariant();
+        Push( L );
+        lua_rawgeti( L, -1, index );
+        lua_remove( L, -2 );
+        return PopValue( L );
+    }
+    /// Return string or number field as string, @c defaultValue otherwise
+    QString String( const QString& key, const QString& defaultValue = QString() ) const {
+        lua_State* L = State();
+        if( !L ) return defaultValue;
+        PushField( L, key );
+        const QString s = lua_isstring( L, -1 ) ? LuaToQString( L, -1 ) : defaultValue;
+        lua_pop( L, 1 );
+        return s;
+    }
+    /// Return number field, @c defaultValue if field is not a number
+    double Number( const QString& key, double defaultValue = 0 ) const {
+        lua_State* L = State();
+        if( !L ) return defaultValue;
+        PushField( L, key );
+        const double n = lua_type( L, -1 ) == LUA_TNUMBER ? lua_tonumber( L, -1 ) : defaultValue;
+        lua_pop( L, 1 );
+        return n;
+    }
+    /// Return number field converted to int, @c defaultValue if field is not
+    /// a number
+    int Int( const QString& key, int defaultValue = 0 ) const {
+        return int( Number( key, defaultValue ) );
+    }
+    /// Return boolean field, @c defaultValue if field is not a boolean
+    bool Bool( const QString& key, bool defaultValue = false ) const {
+        lua_State* L = State();
+        if( !L ) return defaultValue;
+        PushField( L, key );
+        const bool b = lua_isboolean( L, -1 ) ? lua_toboolean( L, -1 ) != 0 : defaultValue;
+        lua_pop( L, 1 );
+        return b;
+    }
+    /// Return reference to nested table, invalid reference if field is not
+    /// a table
+    LuaTableRef Table( const QString& key ) const {
+        lua_State* L = State();
+        if( !L ) return LuaTableRef();
+        PushField( L, key );
+        const LuaTableRef t = lua_istable( L, -1 ) ? LuaTableRef( L, -1, L ) : LuaTableRef();
+        lua_pop( L, 1 );
+        return t;
+    }
+    /// Return keys in traversal order, converted by LuaKeyToQString
+    QStringList Keys() const {
+        QStringList keys;
+        lua_State* L = State();
+        if( !L ) return keys;
+        Push( L );
+        lua_pushnil( L );
+        while( lua_next( L, -2 ) != 0 ) {
+            lua_pop( L, 1 );
+            keys.push_back( LuaKeyToQString( L, -1 ) );
+        }
+        lua_pop( L, 1 );
+        return keys;
+    }
+    /// Convert whole table to QVariantMap
+    QVariantMap ToMap() const {
+        lua_State* L = State();
+        if( !L ) return QVariantMap();
+        Push( L );
+        if( !lua_istable( L, -1 ) ) {
+            lua_pop( L, 1 );
+            return QVariantMap();
+        }
+        return ParseLuaTable( L, -1 );
+    }
+private:
+    /// Registry reference shared by copies
+    struct Data {
+        /// Main Lua state
+        lua_State* L_;
+        /// Registry reference to table
+        int ref_;
+        Data( lua_State* L ) : L_( L ), ref_( LUA_NOREF ) {}
+        ~Data() { luaL_unref( L_, LUA_REGISTRYINDEX, ref_ ); }
+    };
+    /// Number of stack slots required by the accessors; table conversions
+    /// check the stack space required by nested tables
+    enum { STACK_SLOTS = 4 };
+    /// Return main Lua state, null if the reference is invalid or the Lua
+    /// stack cannot grow
+    lua_State* State() const {
+        return data_ && lua_checkstack( data_->L_, STACK_SLOTS ) ? data_->L_ : 0;
+    }
+    /// Push value of field on the Lua stack
+    void PushField( lua_State* L, const QString& key ) const {
+        Push( L );
+        PushQString( L, key );
+        lua_rawget( L, -2 );
+        lua_remove( L, -2 );
+    }
+    /// Convert value on top of the Lua stack and remove it; tables are
+    /// checked before conversion, which never raises errors
+    QVariant PopValue( lua_State* L ) const {
+        const QVariant v = lua_istable( L, -1 ) ? LuaTableToQVariant( L, -1 )
+                                                : LuaValueToQVariant( L, -1 );
+        lua_pop( L, 1 );
+        return v;
+    }
+private:
+    QSharedPointer< Data > data_;
+};
+
+template <> inline const char* TypeName< LuaTableRef >() { return QLUA_TABLE_REF; }
+
+}
@@ -0,0 +1,247 @@
+#pragma once
+//QLua - Copyright (c) 2012, Ugo Varetto
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author and copyright holder nor the
+//       names of contributors to the project may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL UGO VARETTO BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+///@file
+///@brief Incremental traversal of Lua tables.
+
+extern "C" {
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+}
+
+#include <limits>
+
+#include <QVariant>
+#include <QVector>
+#include <QSet>
+
+#include "LuaQtTypes.h"
+
+namespace qlua {
+
+//------------------------------------------------------------------------------
+/// @brief Interface for consumers of the events generated by LuaTableWalker.
+///
+/// Keys are QStrings for string keys, ints or doubles for numeric keys and
+/// booleans for boolean keys; keys of other types are passed as invalid
+/// QVariants. The key of the top-level table is an invalid QVariant.
+struct ILuaTableSink {
+    /// A table begins: the following events refer to the elements of this
+    /// table until the matching @c EndTable
+    /// @param key key of the table in the enclosing table
+    /// @param arrayLength length of the table as returned by the @c # operator
+    virtual void BeginTable( const QVariant& key, int arrayLength ) = 0;
+    /// Non-table value; values converted by LuaValueToQVariant, tables
+    /// containing themselves are passed as invalid QVariants
+    virtual void Value( const QVariant& key, const QVariant& value ) = 0;
+    /// The current table ends
+    virtual void EndTable() = 0;
+    /// Required virtual destructor to allow derived classes to
+    /// invoke proper finalization code
+    virtual ~ILuaTableSink() {}
+};
+
+//------------------------------------------------------------------------------
+/// @brief Convert table key to QVariant as described in ILuaTableSink.
+inline
+QVariant LuaKeyToQVariant( lua_State* L, int idx ) {
+    switch( lua_type( L, idx ) ) {
+        case LUA_TNUMBER: {
+            const lua_Number n = lua_tonumber( L, idx );
+            // converting out of range or non-finite numbers to int is
+            // undefined: numbers are range checked first, NaN fails the check
+            if( n >= lua_Number( std::numeric_limits< int >::min() )
+                && n <= lua_Number( std::numeric_limits< int >::max() ) ) {
+                const int i = int( n );
+                if( lua_Number( i ) == n ) return i;
+            }
+            return double( n );
+        }
+        case LUA_TSTRING: return LuaToQString( L, idx );
+        case LUA_TBOOLEAN: return bool( lua_toboolean( L, idx ) );
+        default: return QVariant();
+    }
+}
+
+//------------------------------------------------------------------------------
+/// @brief Walk a Lua table and its nested tables in steps performing a bounded
+/// amount of work, passing keys and values to an ILuaTableSink.
+///
+/// No copy of the table is created: the caller can consume the elements as
+/// they are visited and return to the Qt event loop between steps, e.g.
+/// calling @c Step from a zero-interval QTimer until it returns @c true.
+/// The elements [1, #t] of each table are visited first and in order, then the
+/// remaining keys in traversal order.
+///
+/// The tables being walked are referenced from the Lua registry, so the
+/// Lua stack can be used freely between steps; tables must however not be
+/// modified until the walk completes, and the walker must not outlive the
+/// Lua state.
+class LuaTableWalker {
+public:
+    /// @brief Constructor.
+    /// @param L Lua state
+    /// @param stackTableIndex index of table in Lua stack
+    /// @param sink event consumer, not owned by the walker
+    LuaTableWalker( lua_State* L, int stackTableIndex, ILuaTableSink* sink )
+        : L_( L ), sink_( sink ), started_( false ) {
+        luaL_checktype( L_, stackTableIndex, LUA_TTABLE );
+        if( stackTableIndex < 0 ) stackTableIndex = lua_gettop( L_ ) + stackTableIndex + 1;
+        // tables being walked are stored at odd indices, the last key
+        // returned by lua_next at the following even index
+        lua_newtable( L_ );
+        lua_pushvalue( L_, stackTableIndex );
+        lua_rawseti( L_, -2, 1 );
+        stateRef_ = luaL_ref( L_, LUA_REGISTRYINDEX );
+        frames_.push_back( Frame( LuaArrayLength( L_, stackTableIndex ) ) );
+        path_.insert( lua_topointer( L_, stackTableIndex ) );
+    }
+    /// Destructor: release reference to the tables
+    ~LuaTableWalker() { luaL_unref( L_, LUA_REGISTRYINDEX, stateRef_ ); }
+    /// @brief Visit at most @c budget elements.
+    ///
+    /// Each value, nested table and table end counts as one element, keys in
+    /// [1, #t] skipped when traversing the non-array part also count as one.
+    /// @return @c true if the walk is complete
+    bool Step( int budget );
+    /// Return @c true if the walk is complete
+    bool Done() const { return frames_.isEmpty(); }
+private:
+    /// State of a table being walked
+    struct Frame {
+        /// Length of array part
+        int size_;
+        /// Index of next element of the array part
+        int next_;
+        /// Set when the array part is complete and the remaining keys are
+        /// traversed through lua_next
+        bool hash_;
+        Frame( int size = 0 ) : size_( size ), next_( 1 ), hash_( size == 0 ) {}
+    };
+    /// Visit next element of the current table; the state table is on top of
+    /// the Lua stack.
+    void Next( int state );
+    /// Remove current table
+    void EndTable( int state );
+private:
+    /// Lua state
+    lua_State* L_;
+    /// Event consumer
+    ILuaTableSink* sink_;
+    /// Set once the @c BeginTable event of the top-level table was generated
+    bool started_;
+    /// Registry reference to the table storing the tables and keys being
+    /// walked
+    int stateRef_;
+    /// Tables being walked, the top-level table is the first one
+    QVector< Frame > frames_;
+    /// Addresses of the tables being walked, used to detect recursive tables
+    QSet< const void* > path_;
+};
+
+//------------------------------------------------------------------------------
+inline
+bool LuaTableWalker::Step( int budget ) {
+    if( frames_.isEmpty() ) return true;
+    if( !started_ ) {
+        started_ = true;
+        sink_->BeginTable( QVariant(), frames_.back().size_ );
+    }
+    lua_rawgeti( L_, LUA_REGISTRYINDEX, stateRef_ );
+    const int state = lua_gettop( L_ );
+    for( ; budget > 0 && !frames_.isEmpty(); --budget ) Next( state );
+    lua_pop( L_, 1 );
+    return frames_.isEmpty();
+}
+
+//------------------------------------------------------------------------------
+inline
+void LuaTableWalker::Next( int state ) {
+    Frame& f = frames_.back();
+    const int tableSlot = 2 * frames_.size() - 1;
+    lua_rawgeti( L_, state, tableSlot );
+    const int table = lua_gettop( L_ );
+    QVariant key;
+    if( !f.hash_ ) {
+        key = f.next_;
+        lua_rawgeti( L_, table, f.next_ );
+        if( ++f.next_ > f.size_ ) f.hash_ = true;
+    } else {
+        lua_rawgeti( L_, state, tableSlot + 1 );
+        if( !lua_next( L_, table ) ) {
+            lua_pop( L_, 1 );
+            EndTable( state );
+            return;
+        }
+        // store key to resume the traversal at the next step
+        lua_pushvalue( L_, -2 );
+        lua_rawseti( L_, state, tableSlot + 1 );
+        if( lua_type( L_, -2 ) == LUA_TNUMBER ) {
+            const lua_Number n = lua_tonumber( L_, -2 );
+            // element of array part, already visited
+            if( n >= 1 && n <= f.size_ && n == lua_Number( int( n ) ) ) {
+                lua_pop( L_, 3 );
+                return;
+            }
+        }
+        key = LuaKeyToQVariant( L_, -2 );
+        lua_remove( L_, -2 );
+    }
+    // table and value on the stack
+    if( lua_istable( L_, -1 ) ) {
+        const void* t = lua_topointer( L_, -1 );
+        if( !path_.contains( t ) ) {
+            const int size = LuaArrayLength( L_, -1 );
+            lua_rawseti( L_, state, tableSlot + 2 );
+            lua_pop( L_, 1 );
+            path_.insert( t );
+            frames_.push_back( Frame( size ) );
+            sink_->BeginTable( key, size );
+            return;
+        }
+    }
+    const QVariant value = lua_istable( L_, -1 ) ? QVariant() : LuaValueToQVariant( L_, -1 );
+    lua_pop( L_, 2 );
+    sink_->Value( key, value );
+}
+
+//------------------------------------------------------------------------------
+inline
+void LuaTableWalker::EndTable( int state ) {
+    const int tableSlot = 2 * frames_.size() - 1;
+    lua_rawgeti( L_, state, tableSlot );
+    path_.remove( lua_topointer( L_, -1 ) );
+    lua_pop( L_, 1 );
+    lua_pushnil( L_ );
+    lua_rawseti( L_, state, tableSlot );
+    lua_pushnil( L_ );
+    lua_rawseti( L_, state, tableSlot + 1 );
+    frames_.pop_back();
+    sink_->EndTable();
+}
+
+}
@@ -0,0 +1,71 @@
+#pragma once
+//QLua - Copyright (c) 2012, Ugo Varetto
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author and copyright holder nor the
+//       names of contributors to the project may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL UGO VARETTO BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <QObject>
+#include <QList>
+#include <QVector>
+#include <QStringList>
+
+/// Object exposing slots with zero to ten arguments, used to measure the
+/// overhead of invoking C++ methods from Lua, and slots copying lists and
+/// vectors, used to measure conversion throughput.
+class BenchObject : public QObject {
+    Q_OBJECT
+public slots:
+    int call0() { return 0; }
+    int call1( int a1 ) { return a1; }
+    int call2( int a1, int a2 ) { return a1 + a2; }
+    int call3( int a1, int a2, int a3 ) { return a1 + a2 + a3; }
+    int call4( int a1, int a2, int a3, int a4 ) { return a1 + a2 + a3 + a4; }
+    int call5( int a1, int a2, int a3, int a4, int a5 ) {
+        return a1 + a2 + a3 + a4 + a5;
+    }
+    int call6( int a1, int a2, int a3, int a4, int a5, int a6 ) {
+        return a1 + a2 + a3 + a4 + a5 + a6;
+    }
+    int call7( int a1, int a2, int a3, int a4, int a5, int a6, int a7 ) {
+        return a1 + a2 + a3 + a4 + a5 + a6 + a7;
+    }
+    int call8( int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8 ) {
+        return a1 + a2 + a3 + a4 + a5 + a6 + a7 + a8;
+    }
+    int call9( int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8,
+               int a9 ) {
+        return a1 + a2 + a3 + a4 + a5 + a6 + a7 + a8 + a9;
+    }
+    int call10( int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8,
+                int a9, int a10 ) {
+        return a1 + a2 + a3 + a4 + a5 + a6 + a7 + a8 + a9 + a10;
+    }
+    QList< double > copyDoubleList( const QList< double >& l ) { return l; }
+    QList< float > copyFloatList( const QList< float >& l ) { return l; }
+    QList< int > copyIntList( const QList< int >& l ) { return l; }
+    QList< short > copyShortList( const QList< short >& l ) { return l; }
+    QVector< double > copyDoubleVector( const QVector< double >& v ) { return v; }
+    QVector< float > copyFloatVector( const QVector< float >& v ) { return v; }
+    QVector< int > copyIntVector( const QVector< int >& v ) { return v; }
+    QVector< short > copyShortVector( const QVector< short >& v ) { return v; }
+    QStringList copyStringList( const QStringList& l ) { return l; }
+};
@@ -32,6 +32,8 @@
 #include <QList>
 #include <QVector>
 
+#include "../LuaTableRef.h"
+
 class TestObject : public QObject {
     Q_OBJECT
 public slots:
@@ -58,6 +60,35 @@ public slots:
     QVector< float > copyFloatVector( const QVector< float >& v ) { return v; }
     QList< short > copyShortList( const QList< short >& l ) { return l; }
     QVector< short > copyShortVector( const QVector< short >& v ) { return v; }
+    int sum11( int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8,
+               int a9, int a10, int a11 ) {
+        return a1 + a2 + a3 + a4 + a5 + a6 + a7 + a8 + a9 + a10 + a11;
+    }
+    QString overloaded( int ) { return "int"; }
+    QString overloaded( const QString& ) { return "QString"; }
+    QString overloaded( const QVariantMap& ) { return "QVariantMap"; }
+    void emitObjectSignal() { emit objectSignal( this ); }
+    QObject* nullObject() { return 0; }
+    QString nameOf( QObject* obj ) { return obj ? obj->objectName() : "null"; }
+    void emitValue( int v ) { emit valueSignal( v ); }
+    QString joinValues( const QString& s, const QList< int >& l ) {
+        int sum = 0;
+        for( QList< int >::const_iterator i = l.begin(); i != l.end(); ++i ) sum += *i;
+        return s + QString::number( sum );
+    }
+    void printValues( const QVariant& v, double d ) {
+        std::cout << v.toString().toStdString() << ' ' << d << std::endl;
+    }
+    QString describe( const qlua::LuaTableRef& t ) {
+        return t.String( "name" ) + ' ' + QString::number( t.Int( "size" ) ) + ' '
+               + QString::number( t.Length() ) + ' ' + t.Table( "sub" ).String( "x", "-" );
+    }
+    void keepTable( const qlua::LuaTableRef& t ) { kept_ = t; }
+    QString keptName() const { return kept_.String( "name" ); }
 signals:
     void aSignal(const QString&);
+    void objectSignal(QObject*);
+    void valueSignal(int);
+private:
+    qlua::LuaTableRef kept_;
 };
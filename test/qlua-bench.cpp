@@ -0,0 +1,107 @@
+//QLua - Copyright (c) 2012, Ugo Varetto
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author and copyright holder nor the
+//       names of contributors to the project may be used to endorse or promote products
+//       derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL UGO VARETTO BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <iostream>
+#include <QElapsedTimer>
+#include <QString>
+#include "../LuaContext.h"
+
+#include "BenchObject.h"
+
+/// Number of method invocations per measurement.
+static const int NUM_CALLS = 1000000;
+
+//------------------------------------------------------------------------------
+/// Invoke method with @c numArgs arguments NUM_CALLS times from Lua and
+/// return the elapsed time in milliseconds.
+qint64 Measure( qlua::LuaContext& ctx, int numArgs ) {
+    QString args;
+    for( int i = 0; i != numArgs; ++i ) {
+        if( i != 0 ) args += ", ";
+        args += QString::number( i + 1 );
+    }
+    const QString code = QString( "for i = 1, %1 do bench.call%2( %3 ) end" )
+                         .arg( NUM_CALLS ).arg( numArgs ).arg( args );
+    QElapsedTimer timer;
+    timer.start();
+    ctx.Eval( code.toAscii().constData() );
+    return timer.elapsed();
+}
+
+/// Number of elements of converted tables.
+static const int NUM_ELEMENTS = 100000;
+/// Number of round-trip conversions per measurement.
+static const int NUM_CONVERSIONS = 20;
+
+//------------------------------------------------------------------------------
+/// Pass a table with NUM_ELEMENTS elements to a method which returns a copy
+/// NUM_CONVERSIONS times, and return the number of elements converted per
+/// second, counting both the Lua -> C++ and the C++ -> Lua conversions.
+double Throughput( qlua::LuaContext& ctx, const char* method, const char* element ) {
+    const QString code = QString( "t = {} for i = 1, %1 do t[ i ] = %2 end" )
+                         .arg( NUM_ELEMENTS ).arg( element );
+    ctx.Eval( code.toAscii().constData() );
+    const QString convert = QString( "for i = 1, %1 do bench.%2( t ) end" )
+                            .arg( NUM_CONVERSIONS ).arg( method );
+    QElapsedTimer timer;
+    timer.start();
+    ctx.Eval( convert.toAscii().constData() );
+    const qint64 elapsed = timer.elapsed();
+    return elapsed == 0 ? 0.0 : 2.0 * NUM_ELEMENTS * NUM_CONVERSIONS * 1000.0 / elapsed;
+}
+
+//------------------------------------------------------------------------------
+int main() {
+    try {
+        qlua::LuaContext ctx;
+        BenchObject bench;
+        ctx.AddQObject( &bench, "bench" );
+        std::cout << "calls: " << NUM_CALLS << std::endl;
+        std::cout << "arguments\tQMetaMethod::invoke (ms)\tQMetaObject::metacall (ms)"
+                  << std::endl;
+        for( int n = 0; n <= 10; ++n ) {
+            ctx.SetDirectInvocation( false );
+            const qint64 invoke = Measure( ctx, n );
+            ctx.SetDirectInvocation( true );
+            const qint64 metacall = Measure( ctx, n );
+            std::cout << n << "\t\t" << invoke << "\t\t\t\t" << metacall << std::endl;
+        }
+        const char* methods[] = { "copyDoubleList", "copyFloatList",
+                                  "copyIntList", "copyShortList",
+                                  "copyDoubleVector", "copyFloatVector",
+                                  "copyIntVector", "copyShortVector",
+                                  "copyStringList" };
+        std::cout << std::endl << "elements: " << NUM_ELEMENTS << std::endl;
+        std::cout << "method\t\t\telements/s" << std::endl;
+        for( int m = 0; m != 9; ++m ) {
+            std::cout << methods[ m ] << "\t\t"
+                      << Throughput( ctx, methods[ m ], m == 8 ? "tostring( i )" : "i % 1000" )
+                      << std::endl;
+        }
+    } catch( const std::exception& e ) {
+        std::cerr << e.what() << std::endl;
+    }
+    return 0;
+}
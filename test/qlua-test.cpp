@@ -24,13 +24,61 @@
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <QPointer>
+#include <QCoreApplication>
+#include <QThread>
 #include <iostream>
 #include "../LuaContext.h"
+#include "../LuaTableWalker.h"
 
 #include "TestObject.h"
 
 //------------------------------------------------------------------------------
-int main() {
+// emit signal from worker thread
+class EmitterThread : public QThread {
+public:
+    EmitterThread( TestObject* obj ) : obj_( obj ) {}
+    void run() { obj_->emitSignal( "worker" ); }
+private:
+    TestObject* obj_;
+};
+
+//------------------------------------------------------------------------------
+// emit signal repeatedly from worker thread
+class ValueEmitterThread : public QThread {
+public:
+    ValueEmitterThread( TestObject* obj, int count ) : obj_( obj ), count_( count ) {}
+    void run() { for( int i = 0; i != count_; ++i ) obj_->emitValue( i ); }
+private:
+    TestObject* obj_;
+    int count_;
+};
+
+//------------------------------------------------------------------------------
+// map method names to names with a prefix
+struct PrefixMapper : ILuaSignatureMapper {
+    PrefixMapper( const QString& prefix ) : prefix_( prefix ) {}
+    QString map( const QString& sig ) const {
+        return prefix_ + qlua::LuaDefaultSignatureMapper().map( sig );
+    }
+    QString prefix_;
+};
+
+//------------------------------------------------------------------------------
+// print events generated by table walker
+struct PrintSink : qlua::ILuaTableSink {
+    void BeginTable( const QVariant& key, int arrayLength ) {
+        std::cout << "begin " << key.toString().toStdString() << ' ' << arrayLength << std::endl;
+    }
+    void Value( const QVariant& key, const QVariant& value ) {
+        std::cout << key.toString().toStdString() << ' ' << value.toString().toStdString() << std::endl;
+    }
+    void EndTable() { std::cout << "end" << std::endl; }
+};
+
+//------------------------------------------------------------------------------
+int main( int argc, char** argv ) {
+    // event loop required by batched and latest signal delivery
+    QCoreApplication app( argc, argv );
     try {
 
         qlua::LuaContext ctx;
@@ -66,6 +114,279 @@ int main() {
 
         ctx.Eval( "fl = myobj3.copyShortList( {1,2,3} );\n" 
                   "print( fl[1] .. ' ' .. fl[ 3 ] );\n" );
+
+        // arguments already created are destroyed when a table element
+        // cannot be converted
+        ctx.Eval( "print( select( 2, pcall( myobj3.joinValues, 'v', { 1, { 2 }, 3 } ) ) );"
+                  "print( myobj3.joinValues( 'v', { 1, 2, 3 } ) )" );
+
+        // only nil and values created by the context are accepted as QObjects
+        ctx.Eval( "print( myobj3.nameOf( myobj3.createObject() ), myobj3.nameOf( nil ), "
+                  "       ( pcall( myobj3.nameOf, io.stdout ) ), ( pcall( myobj3.nameOf, {} ) ) )" );
+
+        // null objects are returned as nil
+        ctx.Eval( "print( myobj3.nullObject() )" );
+
+        // class information is not shared among mappers mapping names differently
+        TestObject mapped1;
+        TestObject mapped2;
+        ctx.AddQObject( &mapped1, "mapped1", false, qlua::LuaContext::QOBJ_NO_DELETE,
+                        PrefixMapper( "a_" ) );
+        ctx.AddQObject( &mapped2, "mapped2", false, qlua::LuaContext::QOBJ_NO_DELETE,
+                        PrefixMapper( "b_" ) );
+        ctx.Eval( "print( mapped1.a_copyString( 'a' ) .. mapped2.b_copyString( 'b' ) .. "
+                  "       tostring( mapped2.a_copyString ) )" );
+
+        // methods with more than ten arguments
+        ctx.Eval( "print( myobj3.sum11( 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 ) )" );
+
+        // overloads selected from the type of Lua arguments
+        ctx.Eval( "print( myobj3.overloaded( 'a' ) .. ' ' .. myobj3.overloaded( {} ) .. ' ' .. "
+                  "myobj3.overloaded( 1 ) .. ' ' .. myobj3.overloaded( 'b' ) )" );
+
+        // typed arrays: QVector<T> data shared between Lua and C++
+        ctx.Eval( "qlua.typedArrays( true );"
+                  "v = myobj3.copyFloatVector( {1,2,3} );"
+                  "v[ 2 ] = 5; v[ #v + 1 ] = 7;"
+                  "w = myobj3.copyFloatVector( v );"
+                  "print( type( w ) .. ' ' .. #w .. ' ' .. w[ 2 ] .. ' ' .. w[ 4 ] );"
+                  "l = myobj3.copyShortList( w ); u = myobj3.copyShortVector( w );"
+                  "print( type( l ) .. ' ' .. #l .. ' ' .. l[ 4 ] .. ' ' .. u[ 2 ] );"
+                  "qlua.typedArrays( false )" );
+
+        // signals are resolved once per signature string: connections made
+        // through a cached signal are delivered and removed
+        ctx.Eval( "values = 'signals'; local n = #qlua.callbackStats();"
+                  "local s = 'valueSignal(int)'; local f = function( v ) values = values .. ' ' .. v end;"
+                  "for i = 1, 3 do "
+                  "  qlua.connect( myobj3, s, f ); myobj3.emitValue( i ); qlua.disconnect( myobj3, s, f ) "
+                  "end;"
+                  "myobj3.emitValue( 4 );"
+                  "print( values .. ' ' .. #qlua.callbackStats() - n )" );
+
+        // QObjects received from signals are pushed as cached wrappers
+        ctx.Eval( "objs = {};"
+                  "qlua.connect( myobj3, 'objectSignal(QObject*)', "
+                  "              function( o ) objs[ #objs + 1 ] = o end );"
+                  "myobj3.emitObjectSignal(); myobj3.emitObjectSignal();"
+                  "print( #objs .. ' ' .. tostring( objs[ 1 ] == objs[ 2 ] ) )" );
+
+        // batched delivery: emissions passed as a single array when the buffer
+        // is full or at the next event loop iteration
+        ctx.Eval( "function batch( b ) "
+                  "  local s = #b; for i, e in ipairs( b ) do s = s .. ' ' .. e[ 1 ] end; print( s ) "
+                  "end;"
+                  "qlua.connect( myobj3, 'aSignal(QString)', batch, { delivery = 'batched', capacity = 2 } );"
+                  "myobj3.emitSignal( 'a' ); myobj3.emitSignal( 'b' ); myobj3.emitSignal( 'c' )" );
+        QCoreApplication::processEvents();
+        // latest-only delivery: a single call with the last emitted values
+        ctx.Eval( "qlua.disconnect( myobj3, 'aSignal(QString)', batch );"
+                  "qlua.connect( myobj3, 'aSignal(QString)', "
+                  "              function( m ) print( 'latest ' .. m ) end, { delivery = 'latest' } );"
+                  "myobj3.emitSignal( 'd' ); myobj3.emitSignal( 'e' )" );
+        QCoreApplication::processEvents();
+
+        // emissions from other threads are queued and delivered in the
+        // thread of the Lua context
+        TestObject emitter;
+        ctx.AddQObject( &emitter, "emitter" );
+        ctx.Eval( "qlua.connect( emitter, 'aSignal(QString)', "
+                  "              function( m ) print( 'received from ' .. m ) end )" );
+        EmitterThread thread( &emitter );
+        thread.start();
+        thread.wait();
+        QCoreApplication::processEvents();
+
+        // coroutines suspended until a signal is emitted
+        ctx.Eval( "co = coroutine.wrap( function() "
+                  "  print( 'resumed with ' .. qlua.wait( emitter, 'aSignal(QString)' ) ) "
+                  "end );"
+                  "co();"
+                  "emitter.emitSignal( 'main' ); emitter.emitSignal( 'again' )" );
+        // coroutines are only resumed while suspended in qlua.wait: not after
+        // yielding failed nor after being resumed from Lua
+        ctx.Eval( "co = coroutine.create( function() "
+                  "  print( 'sort', ( pcall( table.sort, { 1, 2 }, function() "
+                  "    return qlua.wait( emitter, 'aSignal(QString)' ) end ) ) ); "
+                  "  print( 'yield returned ' .. coroutine.yield() ); "
+                  "  print( 'wait returned ' .. qlua.wait( emitter, 'aSignal(QString)' ) ); "
+                  "  print( 'yield returned ' .. coroutine.yield() ) "
+                  "end );"
+                  "coroutine.resume( co ); emitter.emitSignal( 'failed' );"
+                  "coroutine.resume( co, 'lua' ); coroutine.resume( co, 'lua' );"
+                  "emitter.emitSignal( 'resumed' ); coroutine.resume( co, 'lua' )" );
+
+        // errors raised by callbacks and callback statistics
+        emitter.setObjectName( "emitter" );
+        ctx.Eval( "qlua.onCallbackError( function( e ) print( 'callback error: ' .. e:match( '[^\\n]*' ) ) end );"
+                  "function fail() error( 'failure', 0 ) end;"
+                  "qlua.connect( emitter, 'aSignal(QString)', fail );"
+                  "emitter.emitSignal( 'x' );"
+                  "for _, s in ipairs( qlua.callbackStats() ) do "
+                  "  if s.callback == fail then "
+                  "    print( s.senders[ 1 ] .. ' ' .. #s.senders .. ' ' .. s.invocations .. ' ' .. s.errors ) "
+                  "  end "
+                  "end" );
+
+        // signal forwarded to method with different signature through a
+        // native adapter: constant first argument, QString converted to double;
+        // the method is not invoked when the conversion fails
+        TestObject adapted;
+        ctx.AddQObject( &adapted, "adapted" );
+        ctx.Eval( "qlua.connect( adapted, 'aSignal(QString)', adapted, 'printValues(QVariant,double)',"
+                  "              { { 'value' }, 1 } );"
+                  "adapted.emitSignal( '3' ); adapted.emitSignal( 'three' );"
+                  "print( select( 2, pcall( qlua.connect, adapted, 'aSignal(QString)', adapted, "
+                  "                         'printValues(QVariant,double)', { { 'value' }, { 'three' } } ) ) )" );
+
+        // weak connections are released when the function is collected,
+        // connections are released when the sender is destroyed
+        TestObject weakEmitter;
+        ctx.AddQObject( &weakEmitter, "weakEmitter" );
+        ctx.Eval( "function numCallbacks() return #qlua.callbackStats() end;"
+                  "n = numCallbacks();"
+                  "qlua.connect( weakEmitter, 'aSignal(QString)', "
+                  "              function( m ) print( 'weak ' .. m ) end, { weak = true } );"
+                  "weakEmitter.emitSignal( 'before' );"
+                  "collectgarbage( 'collect' ); collectgarbage( 'collect' );"
+                  "weakEmitter.emitSignal( 'after' );"
+                  "print( 'weak connections ' .. numCallbacks() - n )" );
+        TestObject* transient = new TestObject;
+        ctx.AddQObject( transient, "transient" );
+        ctx.Eval( "qlua.connect( transient, 'aSignal(QString)', function() end )" );
+        delete transient;
+        ctx.Eval( "print( 'connections ' .. numCallbacks() - n )" );
+
+        // all the emissions from a worker thread are delivered; functions
+        // connected and disconnected while a worker thread emits
+        TestObject racer;
+        ctx.AddQObject( &racer, "racer" );
+        ctx.Eval( "received = 0; function count() received = received + 1 end;"
+                  "qlua.connect( racer, 'valueSignal(int)', count )" );
+        ValueEmitterThread counter( &racer, 100 );
+        counter.start();
+        counter.wait();
+        QCoreApplication::processEvents();
+        ctx.Eval( "qlua.disconnect( racer, 'valueSignal(int)', count );"
+                  "print( 'received ' .. received ); n = numCallbacks()" );
+        ValueEmitterThread racing( &racer, 100000 );
+        racing.start();
+        for( int i = 0; i != 200; ++i ) {
+            ctx.Eval( "qlua.connect( racer, 'valueSignal(int)', count );"
+                      "qlua.disconnect( racer, 'valueSignal(int)', count )" );
+            QCoreApplication::processEvents();
+        }
+        racing.wait();
+        QCoreApplication::processEvents();
+        ctx.Eval( "print( 'race connections ' .. numCallbacks() - n )" );
+
+        // ids released while a worker emits are not reused by connections
+        // with different parameter types
+        ctx.Eval( "bad = 0; function strings( s ) if type( s ) ~= 'string' then bad = bad + 1 end end" );
+        ValueEmitterThread retyping( &racer, 100000 );
+        retyping.start();
+        for( int i = 0; i != 200; ++i ) {
+            ctx.Eval( "qlua.connect( racer, 'valueSignal(int)', count );"
+                      "qlua.disconnect( racer, 'valueSignal(int)', count );"
+                      "qlua.connect( racer, 'aSignal(QString)', strings );"
+                      "qlua.disconnect( racer, 'aSignal(QString)', strings )" );
+            QCoreApplication::processEvents();
+        }
+        retyping.wait();
+        QCoreApplication::processEvents();
+        ctx.Eval( "print( 'retyped ' .. bad .. ' ' .. numCallbacks() - n )" );
+
+        // handlers invoked by priority, returning true stops propagation
+        TestObject multicast;
+        ctx.AddQObject( &multicast, "multicast" );
+        ctx.Eval( "qlua.connect( multicast, 'aSignal(QString)', "
+                  "              function( m ) print( 'low ' .. m ) end, { priority = 1 } );"
+                  "qlua.connect( multicast, 'aSignal(QString)', "
+                  "              function( m ) print( 'high ' .. m ) end, { priority = 10 } );"
+                  "function stop( m ) print( 'stop ' .. m ); return m == 'stop' end;"
+                  "qlua.connect( multicast, 'aSignal(QString)', stop, { priority = 5 } );"
+                  "multicast.emitSignal( 'all' ); multicast.emitSignal( 'stop' );"
+                  "qlua.disconnect( multicast, 'aSignal(QString)', stop );"
+                  "multicast.emitSignal( 'stop' )" );
+
+        // connections repeatedly added and removed are delivered once and
+        // leave no connection behind
+        ctx.Eval( "hits = 0; n = numCallbacks(); local f = function() hits = hits + 1 end;"
+                  "for i = 1, 1000 do"
+                  "  qlua.connect( multicast, 'valueSignal(int)', f, { priority = 1 } );"
+                  "  qlua.connect( multicast, 'aSignal(QString)', f );"
+                  "  multicast.emitValue( i );"
+                  "  qlua.disconnect( multicast, 'valueSignal(int)', f );"
+                  "  qlua.disconnect( multicast, 'aSignal(QString)', f )"
+                  "end;"
+                  "multicast.emitValue( 0 );"
+                  "print( 'cycles ' .. hits .. ' ' .. numCallbacks() - n )" );
+
+        // proxy mode: methods resolved on first access, invoked with ':'
+        ctx.SetObjectWrapMode( qlua::LuaContext::QOBJ_WRAP_PROXY );
+        TestObject myobj4;
+        myobj4.setObjectName( "MyObject4" );
+        ctx.AddQObject( &myobj4, "myobj4" );
+        ctx.Eval( "print( myobj4.objectName .. ' ' .. myobj4:copyString( 'proxy' ) )" );
+        // proxy methods only accept proxies of their class as 'self'
+        QObject plain;
+        ctx.AddQObject( &plain, "plain" );
+        ctx.Eval( "print( ( pcall( myobj4.copyString, io.stdout, 'x' ) ), "
+                  "       ( pcall( myobj4.copyString, plain, 'x' ) ), "
+                  "       ( pcall( myobj4.copyString, 'x' ) ), "
+                  "       myobj4.copyString( myobj4, 'self' ) )" );
+        ctx.SetObjectWrapMode( qlua::LuaContext::QOBJ_WRAP_TABLE );
+
+        // live properties: values are read from/written to the QObject
+        ctx.SetLiveProperties( true );
+        TestObject myobj5;
+        ctx.AddQObject( &myobj5, "myobj5" );
+        ctx.Eval( "myobj5.objectName = 'MyObject5'" );
+        std::cout << myobj5.objectName().toStdString() << std::endl;
+        ctx.Eval( "print( myobj5.objectName )" );
+        ctx.SetLiveProperties( false );
+
+        // UTF-8 strings; property, method names and map keys pushed from the
+        // key cache
+        ctx.SetInternKeys( true );
+        TestObject myobj6;
+        myobj6.setObjectName( "MyObject6" );
+        ctx.AddQObject( &myobj6, "myobj6" );
+        ctx.Eval( "s = myobj6.copyString( '\xc3\xa8t\xc3\xa9' );"
+                  "print( myobj6.objectName .. ' ' .. #s .. ' ' .. s )" );
+        ctx.Eval( "l = myobj6.copyVariantList( { { id = 1, name = 'a' }, { id = 2, name = 'b' },"
+                  "                                 { name = 'c', extra = true } } );"
+                  "print( l[ 1 ].name .. l[ 2 ].name .. l[ 3 ].name .. l[ 2 ].id .. tostring( l[ 3 ].extra ) )" );
+        ctx.SetInternKeys( false );
+
+        // table walked in steps of at most two elements
+        ctx.Eval( "walk = { 10, 20, sub = { 'x' } }" );
+        lua_getglobal( ctx.LuaState(), "walk" );
+        PrintSink sink;
+        qlua::LuaTableWalker walker( ctx.LuaState(), -1, &sink );
+        lua_pop( ctx.LuaState(), 1 );
+        int steps = 1;
+        while( !walker.Step( 2 ) ) ++steps;
+        std::cout << "walk steps " << steps << std::endl;
+        // numeric keys out of the range of int are reported as doubles
+        ctx.Eval( "walk = { [ 2^40 ] = 'big' }" );
+        lua_getglobal( ctx.LuaState(), "walk" );
+        qlua::LuaTableWalker bigKeyWalker( ctx.LuaState(), -1, &sink );
+        lua_pop( ctx.LuaState(), 1 );
+        while( !bigKeyWalker.Step( 2 ) );
+
+        // nested sequences converted to lists, recursive tables to nil
+        ctx.Eval( "c = { list = { 1, 2, { 3, 4 } }, map = { a = 'b' }, [ 1.5 ] = 'x' }; c.self = c;"
+                  "t = myobj6.copyVariantMap( c );"
+                  "print( #t.list .. ' ' .. t.list[ 3 ][ 2 ] .. ' ' .. t.map.a .. ' ' .. t[ '1.5' ] .. ' ' .. tostring( t.self ) )" );
+
+        // table passed by reference, fields read on access
+        ctx.Eval( "print( myobj6.describe( { 7, 8, name = 'big', size = 3, sub = { x = 'y' } } ) )" );
+
+        // references created from coroutines outlive the coroutines
+        ctx.Eval( "coroutine.wrap( function() myobj6.keepTable( { name = 'kept' } ) end )();"
+                  "collectgarbage(); collectgarbage();"
+                  "print( myobj6.keptName() )" );
          
     } catch( const std::exception& e ) {
         std::cerr << e.what() << std::endl;